@@ -0,0 +1,39 @@
+#include "batch_runner.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// plays a batch of games with the mixed autopilot policy and prints totals
+// usage: tdd-breakout-batch [games] [threads] [max ticks]
+int main(int argc, char** argv) {
+  batch_config_t config;
+  config.games_ = argc > 1 ? std::stoull(argv[1]) : 10000;
+  if (argc > 2) {
+    config.threads_ = std::stoi(argv[2]);
+  }
+  if (argc > 3) {
+    config.max_ticks_ = std::stoi(argv[3]);
+  }
+
+  const auto begin = std::chrono::steady_clock::now();
+  const batch_result_t result = run_batch(config, batch_autopilot_t{});
+  const double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - begin)
+                           .count();
+
+  std::printf(
+    "%llu games on %d threads in %.2fs (%.0f games/s, %.1fM ticks/s)\n",
+    static_cast<unsigned long long>(result.games_), batch_thread_count(config),
+    seconds,
+    double(result.games_) / seconds, double(result.ticks_) / seconds / 1e6);
+  std::printf(
+    "completed %llu, timed out %llu, mean score %.1f, best score %d, "
+    "mean length %.0f ticks\n",
+    static_cast<unsigned long long>(result.completed_),
+    static_cast<unsigned long long>(result.timed_out_),
+    double(result.score_) / double(std::max<uint64_t>(result.games_, 1)),
+    result.best_score_,
+    double(result.ticks_) / double(std::max<uint64_t>(result.games_, 1)));
+  return 0;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// totals over a batch of games played to the end
+struct batch_result_t {
+  uint64_t games_ = 0;
+  uint64_t completed_ = 0; // every block destroyed
+  uint64_t timed_out_ = 0; // still going after max_ticks
+  uint64_t ticks_ = 0;
+  uint64_t completed_ticks_ = 0; // over the games completed
+  uint64_t lives_lost_ = 0;
+  uint64_t score_ = 0;
+  int best_score_ = 0;
+
+  void add(const batch_result_t& other) {
+    games_ += other.games_;
+    completed_ += other.completed_;
+    timed_out_ += other.timed_out_;
+    ticks_ += other.ticks_;
+    completed_ticks_ += other.completed_ticks_;
+    lives_lost_ += other.lives_lost_;
+    score_ += other.score_;
+    best_score_ = std::max(best_score_, other.best_score_);
+  }
+};
+
+inline bool operator==(const batch_result_t& lhs, const batch_result_t& rhs) {
+  return lhs.games_ == rhs.games_ && lhs.completed_ == rhs.completed_
+      && lhs.timed_out_ == rhs.timed_out_ && lhs.ticks_ == rhs.ticks_
+      && lhs.completed_ticks_ == rhs.completed_ticks_
+      && lhs.lives_lost_ == rhs.lives_lost_ && lhs.score_ == rhs.score_
+      && lhs.best_score_ == rhs.best_score_;
+}
+
+struct batch_config_t {
+  uint64_t games_;
+  int threads_ = int(std::thread::hardware_concurrency());
+  int max_ticks_ = 100000;
+  vec2 board_size_ = {101, 30};
+};
+
+// worker threads run_batch plays the batch on (threads_ may be 0 where the
+// hardware concurrency is unknown)
+[[nodiscard]] int batch_thread_count(const batch_config_t& config) {
+  return std::max(config.threads_, 1);
+}
+
+// the share of a batch a worker has yet to play, kept on its own cache line
+// as idle workers lock it to steal half of what is left
+struct alignas(64) batch_queue_t {
+  std::mutex lock_;
+  uint64_t next_ = 0;
+  uint64_t end_ = 0;
+};
+
+// plays game until it ends (or max_ticks pass) seeded with its index, calling
+// policy(breakout, game_index, tick) before every step
+template<typename policy_fn_t>
+void play_batch_game(
+  breakout_t& breakout, const uint64_t game_index, const int max_ticks,
+  policy_fn_t& policy, batch_result_t& result) {
+  breakout.set_seed(game_index);
+  breakout.restart();
+  int tick = 0;
+  for (; tick < max_ticks; ++tick) {
+    const auto state = breakout.state();
+    if (
+      state == breakout_t::game_state_e::game_over
+      || state == breakout_t::game_state_e::game_complete) {
+      break;
+    }
+    policy(breakout, game_index, tick);
+    breakout.step();
+  }
+  result.games_++;
+  result.ticks_ += uint64_t(tick);
+  result.lives_lost_ += uint64_t(breakout.starting_lives() - breakout.lives());
+  result.score_ += uint64_t(breakout.score());
+  result.best_score_ = std::max(result.best_score_, breakout.score());
+  if (breakout.state() == breakout_t::game_state_e::game_complete) {
+    result.completed_++;
+    result.completed_ticks_ += uint64_t(tick);
+  } else if (tick == max_ticks) {
+    result.timed_out_++;
+  }
+}
+
+// plays games_ games across a pool of threads, each starting with an equal
+// share of the game indices and stealing the back half of another worker's
+// share once it runs out, every worker reuses a single game built on its own
+// thread and keeps its totals locally until the end (policy is copied for
+// each worker)
+template<typename policy_fn_t>
+batch_result_t run_batch(const batch_config_t& config, policy_fn_t policy) {
+  const int threads = batch_thread_count(config);
+  const auto queues = std::make_unique<batch_queue_t[]>(threads);
+  for (int i = 0; i < threads; ++i) {
+    queues[i].next_ = config.games_ * uint64_t(i) / uint64_t(threads);
+    queues[i].end_ = config.games_ * uint64_t(i + 1) / uint64_t(threads);
+  }
+  std::vector<batch_result_t> results(threads);
+
+  const auto take = [&](const int worker, uint64_t& game_index) {
+    batch_queue_t& own = queues[worker];
+    {
+      const std::lock_guard<std::mutex> lock(own.lock_);
+      if (own.next_ < own.end_) {
+        game_index = own.next_++;
+        return true;
+      }
+    }
+    // no work left here, take the back half of another worker's share
+    for (int i = 1; i < threads; ++i) {
+      batch_queue_t& victim = queues[(worker + i) % threads];
+      uint64_t begin = 0;
+      uint64_t end = 0;
+      {
+        const std::lock_guard<std::mutex> lock(victim.lock_);
+        const uint64_t left = victim.end_ - victim.next_;
+        if (left == 0) {
+          continue;
+        }
+        begin = victim.end_ - (left + 1) / 2;
+        end = victim.end_;
+        victim.end_ = begin;
+      }
+      const std::lock_guard<std::mutex> lock(own.lock_);
+      own.next_ = begin + 1;
+      own.end_ = end;
+      game_index = begin;
+      return true;
+    }
+    return false;
+  };
+
+  const auto work = [&](const int worker) {
+    breakout_t breakout;
+    breakout.setup(0, 0, config.board_size_.x_, config.board_size_.y_);
+    policy_fn_t worker_policy = policy; // each worker plays with its own copy
+    batch_result_t result;
+    for (uint64_t game_index = 0; take(worker, game_index);) {
+      play_batch_game(
+        breakout, game_index, config.max_ticks_, worker_policy, result);
+    }
+    results[worker] = result;
+  };
+
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threads; ++i) {
+    pool.emplace_back(work, i);
+  }
+  work(0);
+  for (auto& thread : pool) {
+    thread.join();
+  }
+
+  batch_result_t total;
+  for (const auto& result : results) {
+    total.add(result);
+  }
+  return total;
+}
+
+// a reproducible mix of autopilot and random moves, drawn from the game's
+// seed so every game in a batch plays differently
+struct batch_autopilot_t {
+  int mistake_per_mille_ = 150; // chance of a random move each tick
+
+  void operator()(breakout_t& breakout, uint64_t /*game_index*/, int tick)
+    const {
+    if (breakout.state() == breakout_t::game_state_e::preparing) {
+      breakout.launch_random();
+      return;
+    }
+    const counter_rng_t rng = breakout.rng(rng_stream_e::policy);
+    if (rng.below(1000, uint64_t(tick)) < mistake_per_mille_) {
+      rng.below(2, uint64_t(tick), 1) == 0 ? breakout.move_paddle_left(2)
+                                           : breakout.move_paddle_right(2);
+    } else {
+      autopilot(breakout, 2);
+    }
+  }
+};
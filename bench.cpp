@@ -0,0 +1,598 @@
+#include "batch_runner.h"
+#include "breakout.h"
+#include "glyph_table.h"
+#include "level_search.h"
+#include "packed_game.h"
+#include "rasterize.h"
+#include "render_layers.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// heap allocations made so far, counted to show which paths make none
+std::atomic<uint64_t> allocations = 0;
+
+void* operator new(const size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+// over-aligned types (such as packed_game_t) come through here
+void* operator new(const size_t size, const std::align_val_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  const auto align = size_t(alignment);
+#ifdef _MSC_VER
+  void* memory = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+  const size_t rounded = (std::max(size, size_t(1)) + align - 1) & ~(align - 1);
+  void* memory = std::aligned_alloc(align, rounded);
+#endif
+  if (memory != nullptr) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+// kept out of line so the compiler does not see free() inlined against its
+// own notion of operator new and warn of a mismatch, the sized and aligned
+// forms forward to it
+[[gnu::noinline]] void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+void operator delete(void* memory, size_t) noexcept { operator delete(memory); }
+void operator delete(void* memory, const std::align_val_t) noexcept {
+#ifdef _MSC_VER
+  _aligned_free(memory);
+#else
+  operator delete(memory);
+#endif
+}
+void operator delete(
+  void* memory, size_t, const std::align_val_t alignment) noexcept {
+  operator delete(memory, alignment);
+}
+
+struct display_null_t : public display_t {
+  int count_ = 0;
+  void output(int, int, std::string_view) override { count_++; }
+};
+
+// average time in nanoseconds of a single call to fn over iterations calls
+template<typename Fn>
+double measure_ns(const int iterations, Fn&& fn) {
+  const auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    fn();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - begin).count()
+       / iterations;
+}
+
+// last level cache misses of this thread between start() and stop(), if the
+// kernel lets us count them
+class cache_miss_counter_t {
+public:
+  cache_miss_counter_t() {
+#ifdef __linux__
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+  }
+  ~cache_miss_counter_t() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+#endif
+  }
+  cache_miss_counter_t(const cache_miss_counter_t&) = delete;
+  cache_miss_counter_t& operator=(const cache_miss_counter_t&) = delete;
+
+  void start() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+  std::optional<uint64_t> stop() {
+#ifdef __linux__
+    uint64_t count = 0;
+    if (
+      fd_ >= 0 && ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0) == 0
+      && read(fd_, &count, sizeof(count)) == ssize_t(sizeof(count))) {
+      return count;
+    }
+#endif
+    return {};
+  }
+
+private:
+  int fd_ = -1;
+};
+
+// render time of display_blocks as a large board is progressively cleared
+void bench_render_remaining_blocks() {
+  breakout_t breakout;
+  breakout.setup(0, 0, 101, 30);
+  blocks_t blocks = create_blocks(breakout);
+  blocks.col_count = 1000;
+  blocks.row_count = 100;
+  reset_blocks(blocks);
+
+  std::printf("render: remaining blocks vs time per frame\n");
+  const int total = blocks.col_count * blocks.row_count;
+  for (const int percent : {100, 50, 25, 10, 1}) {
+    const int target = total * percent / 100;
+    // destroy blocks spread across the whole board (stride is coprime with
+    // the block count so every block is eventually visited)
+    for (int id = 0; blocks_remaining(blocks) > target;
+         id = (id + 7919) % total) {
+      destroy_block(blocks, id % blocks.col_count, id / blocks.col_count);
+    }
+    display_null_t display;
+    const double ns = measure_ns(20, [&] {
+      display_blocks(blocks, vec2{0, 0}, display, std::string_view{"*"});
+    });
+    std::printf(
+      "  %7d blocks %12.0f ns/frame %8.2f ns/block\n",
+      blocks_remaining(blocks), ns, ns / std::max(blocks_remaining(blocks), 1));
+  }
+}
+
+// balls tested per second against a row of blocks, scalar vs row kernel
+void bench_row_kernel() {
+  std::printf("row kernel (%s) vs scalar\n", row_kernel().name_);
+  for (const int width : {11, 1000}) {
+    std::vector<row_extents_t> chunks;
+    for (int first = 0; first < width; first += 64) {
+      chunks.push_back(
+        row_extents_t{2 + first * 9, 9, 8, std::min(64, width - first)});
+    }
+    std::vector<int> xs(1024);
+    for (size_t i = 0; i < xs.size(); ++i) {
+      xs[i] = int((i * 7919) % (width * 9 + 4));
+    }
+    const auto run = [&](const row_hit_mask_fn_t hit_mask) {
+      uint64_t sink = 0;
+      const double ns = measure_ns(200, [&] {
+        for (const int x : xs) {
+          for (const auto& chunk : chunks) {
+            sink ^= hit_mask(chunk, x);
+          }
+        }
+      });
+      volatile uint64_t keep = sink;
+      (void)keep;
+      return xs.size() / ns * 1000.0; // balls per microsecond
+    };
+    const double scalar = run(row_hit_mask_scalar);
+    const double simd = run(row_kernel().hit_mask_);
+    std::printf(
+      "  %4d wide: scalar %8.2f balls/us, %s %8.2f balls/us (x%.1f)\n",
+      width, scalar, row_kernel().name_, simd, simd / scalar);
+    // every ball against each chunk in one call, vectorised across balls
+    std::vector<uint64_t> masks(xs.size());
+    uint64_t sink = 0;
+    const double ns = measure_ns(200, [&] {
+      for (const auto& chunk : chunks) {
+        row_kernel().hit_masks_(chunk, xs.data(), int(xs.size()), masks.data());
+        sink ^= masks[0] ^ masks.back();
+      }
+    });
+    volatile uint64_t keep = sink;
+    (void)keep;
+    const double batched = xs.size() / ns * 1000.0;
+    std::printf(
+      "  %4d wide: %s batched %8.2f balls/us (x%.1f)\n", width,
+      row_kernel().name_, batched, batched / scalar);
+  }
+}
+
+// screen scrapes display calls into a grid of cells
+struct display_grid_t : public display_t {
+  vec2 size_;
+  uint8_t value_ = 0;
+  std::vector<uint8_t> cells_;
+  void output(int x, int y, std::string_view) override {
+    if (x >= 0 && y >= 0 && x < size_.x_ && y < size_.y_) {
+      cells_[y * size_.x_ + x] = value_;
+    }
+  }
+};
+
+// observation cost, rasterizer vs scraping the display calls
+void bench_rasterize() {
+  breakout_t breakout;
+  breakout.setup(0, 0, 101, 30);
+  breakout.launch_left();
+  for (int i = 0; i < 10; ++i) {
+    breakout.step();
+  }
+
+  const vec2 size = raster_size(breakout, 1);
+  std::vector<uint8_t> raster(size.x_ * size.y_);
+  const double raster_ns =
+    measure_ns(20000, [&] { rasterize(breakout, raster.data()); });
+
+  display_grid_t display;
+  display.size_ = size;
+  display.cells_.resize(size.x_ * size.y_);
+  const std::string_view glyph = "*";
+  const double display_ns = measure_ns(20000, [&] {
+    std::fill(display.cells_.begin(), display.cells_.end(), 0);
+    display.value_ = 1;
+    breakout.display_board(display, glyph, glyph, glyph, glyph, glyph, glyph);
+    display.value_ = 2;
+    breakout.display_blocks(display, glyph);
+    display.value_ = 3;
+    breakout.display_paddle(display, glyph);
+    display.value_ = 4;
+    breakout.display_ball(display, glyph);
+  });
+  std::printf(
+    "observation: rasterize %.0f ns, display scrape %.0f ns (%.0f%%)\n",
+    raster_ns, display_ns, raster_ns / display_ns * 100.0);
+}
+
+// cost of drawing a frame of play and the cells sent to the display,
+// redrawing everything every frame with string glyphs vs updating and
+// compositing layers of glyph ids (resolved to strings as they are sent),
+// the display here drops cells for free so the layers only pay off with a
+// display where each cell sent costs (a terminal)
+void bench_render_layers() {
+  const std::string_view strings[] = {
+    "\xE2\x94\x81", "\xE2\x94\x83", "\xE2\x94\x8F",
+    "\xE2\x94\x93", "\xE2\x94\x97", "\xE2\x94\x9b",
+    "\xE2\x96\x91", "\xE2\x96\x92", "\xE2\x98\xBB"};
+  glyph_table_t table;
+  const breakout_glyphs_t glyphs{
+    table.intern(strings[0]), table.intern(strings[1]),
+    table.intern(strings[2]), table.intern(strings[3]),
+    table.intern(strings[4]), table.intern(strings[5]),
+    table.intern(strings[6]), table.intern(strings[7]),
+    table.intern(strings[8])};
+  const auto play = [](breakout_t& breakout, const auto& draw) {
+    breakout.setup(10, 5, 101, 30);
+    constexpr int frames = 20000;
+    double ns = 0.0;
+    for (int frame = 0; frame < frames; ++frame) {
+      switch (breakout.state()) {
+        case breakout_t::game_state_e::preparing:
+          breakout.launch_random();
+          break;
+        case breakout_t::game_state_e::game_over:
+        case breakout_t::game_state_e::game_complete:
+          breakout.restart();
+          break;
+        default:
+          autopilot(breakout, 2);
+      }
+      breakout.step();
+      ns += measure_ns(1, draw);
+    }
+    return ns / frames;
+  };
+
+  breakout_t breakout;
+  display_null_t redrawn;
+  const double redraw_ns = play(breakout, [&] {
+    breakout.display_board(
+      redrawn, strings[0], strings[1], strings[2], strings[3], strings[4],
+      strings[5]);
+    breakout.display_blocks(redrawn, strings[7]);
+    breakout.display_paddle(redrawn, strings[6]);
+    breakout.display_ball(redrawn, strings[8]);
+  });
+  breakout_layers_t layers(glyphs);
+  display_null_t composited;
+  glyph_resolver_t resolver(table, composited);
+  const double layered_ns = play(breakout, [&] {
+    layers.update(breakout);
+    layers.layers().composite(resolver);
+  });
+  std::printf(
+    "render layers: redraw %.0f ns %.0f cells/frame, layered %.0f ns "
+    "%.1f cells/frame (%zu byte cells)\n",
+    redraw_ns, redrawn.count_ / 20000.0, layered_ns,
+    composited.count_ / 20000.0, sizeof(glyph_id_t));
+}
+
+// rollout ticks per second stepping every tick vs jumping free runs, with
+// and without the trajectory cache (the autopilot moves once per run)
+void bench_trajectory_cache() {
+  const auto rollouts = [](breakout_t& breakout, const bool jump) {
+    const auto begin = std::chrono::steady_clock::now();
+    uint64_t ticks = 0;
+    for (uint64_t seed = 0; seed < 200; ++seed) {
+      breakout.set_seed(seed);
+      breakout.restart();
+      for (int played = 0; played < 3000;) {
+        autopilot(breakout, 100);
+        const int run = jump ? breakout.step_free_flight(3000 - played) : 0;
+        played += run;
+        if (played < 3000) {
+          breakout.step();
+          ++played;
+        }
+      }
+      ticks += 3000;
+    }
+    const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count();
+    return double(ticks) / seconds / 1e6;
+  };
+
+  breakout_t stepped;
+  stepped.setup(0, 0, 101, 30);
+  breakout_t uncached;
+  uncached.setup(0, 0, 101, 30);
+  breakout_t cached;
+  cached.setup(0, 0, 101, 30);
+  cached.enable_trajectory_cache(4096);
+  const double stepped_rate = rollouts(stepped, false);
+  const double uncached_rate = rollouts(uncached, true);
+  const double cached_rate = rollouts(cached, true);
+  std::printf(
+    "trajectory cache: step %.1fM ticks/s, free flight %.1fM ticks/s, "
+    "cached %.1fM ticks/s (%.0f%% hits)\n",
+    stepped_rate, uncached_rate, cached_rate,
+    cached.trajectory_cache_stats().hit_rate() * 100.0);
+}
+
+// ticks per second advancing to the next block or state change with a step()
+// loop vs step_n(), the autopilot moving only between calls
+void bench_step_n() {
+  const auto rollouts = [](breakout_t& breakout, const bool bulk) {
+    const auto begin = std::chrono::steady_clock::now();
+    uint64_t ticks = 0;
+    for (uint64_t seed = 0; seed < 200; ++seed) {
+      breakout.set_seed(seed);
+      breakout.restart();
+      for (int played = 0; played < 3000;) {
+        autopilot(breakout, 100);
+        if (bulk) {
+          played += breakout.step_n(3000 - played).ticks_;
+          continue;
+        }
+        const auto state = breakout.state();
+        const int blocks = breakout.blocks_remaining();
+        while (played < 3000 && breakout.state() == state
+               && breakout.blocks_remaining() == blocks) {
+          breakout.step();
+          ++played;
+        }
+      }
+      ticks += 3000;
+    }
+    const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count();
+    return double(ticks) / seconds / 1e6;
+  };
+
+  breakout_t stepped;
+  stepped.setup(0, 0, 101, 30);
+  breakout_t bulk;
+  bulk.setup(0, 0, 101, 30);
+  breakout_t cached;
+  cached.setup(0, 0, 101, 30);
+  cached.enable_trajectory_cache(4096);
+  const double stepped_rate = rollouts(stepped, false);
+  const double bulk_rate = rollouts(bulk, true);
+  const double cached_rate = rollouts(cached, true);
+  std::printf(
+    "step_n: step loop %.1fM ticks/s, step_n %.1fM ticks/s (%.1fx), "
+    "cached %.1fM ticks/s (%.1fx)\n",
+    stepped_rate, bulk_rate, bulk_rate / stepped_rate, cached_rate,
+    cached_rate / stepped_rate);
+}
+
+// time and allocations of a restart() after a short game, blocks created
+// afresh each game vs laid out in the storage of an earlier game
+void bench_restart() {
+  std::printf("restart: blocks created afresh vs laid out in reused storage\n");
+  const auto bench = [](
+                       const char* name, breakout_t& breakout,
+                       const bool random_seed) {
+    constexpr int restarts = 20000;
+    uint64_t allocated = 0;
+    double ns = 0.0;
+    for (int i = 0; i < restarts; ++i) {
+      breakout.set_seed(random_seed ? uint64_t(i) : 0);
+      breakout.launch_left();
+      for (int tick = 0; tick < 50; ++tick) {
+        breakout.step();
+      }
+      const uint64_t before = allocations.load();
+      ns += measure_ns(1, [&] { breakout.restart(); });
+      allocated += allocations.load() - before;
+    }
+    std::printf(
+      "  %-22s %8.0f ns %6.2f allocations per restart\n", name,
+      ns / restarts, double(allocated) / restarts);
+  };
+
+  breakout_t grid;
+  grid.setup(0, 0, 101, 30);
+  grid.set_create_blocks_fn(
+    [](const breakout_t& breakout) { return create_blocks(breakout); });
+  bench("grid, afresh", grid, false);
+  grid.setup(0, 0, 101, 30);
+  bench("grid, reused", grid, false);
+
+  breakout_t level;
+  level.setup(0, 0, 101, 30);
+  const std::vector<cell_rect_t> rects =
+    create_random_blocks(level, 600).rects_;
+  level.set_create_blocks_fn(
+    [&rects](const breakout_t&) { return create_free_form_blocks(rects); });
+  bench("level, afresh", level, false);
+  level.set_layout_blocks_fn(level_blocks_fn(rects));
+  bench("level, reused", level, false);
+
+  breakout_t random;
+  random.setup(0, 0, 101, 30);
+  random.set_create_blocks_fn([](const breakout_t& breakout) {
+    return create_random_blocks(breakout, 600);
+  });
+  bench("random levels, afresh", random, true);
+  random.set_layout_blocks_fn([](const breakout_t& breakout, blocks_t& blocks) {
+    layout_random_blocks(breakout, 600, blocks);
+  });
+  bench("random levels, reused", random, true);
+}
+
+// memory a game keeps (the game and its current blocks, not counting the
+// spare blocks restart() reuses, logs or caches that are off)
+size_t breakout_bytes(const breakout_t& breakout) {
+  const blocks_t& blocks = breakout.blocks();
+  return sizeof(breakout)
+       + blocks.chunks_.capacity() * sizeof(block_chunk_t)
+       + blocks.row_counts_.capacity() * sizeof(int)
+       + blocks.live_rows_.capacity() * sizeof(uint64_t)
+       + blocks.block_ids_.capacity() * sizeof(int)
+       + blocks.block_id_index_.capacity() * sizeof(int)
+       + blocks.rects_.capacity() * sizeof(cell_rect_t);
+}
+
+// games per MB and the time and cache misses per game-tick stepping a large
+// batch round robin (a tick of every game in turn) as breakout_t games vs a
+// packed batch, both following the ball with the same moves
+void bench_packed_games() {
+  constexpr int games = 20000;
+  constexpr int rounds = 300;
+  const auto report = [](
+                        const char* name, const double bytes_per_game,
+                        const double ns,
+                        const std::optional<uint64_t> misses) {
+    const double ticks = double(games) * rounds;
+    std::printf(
+      "  %-9s %5.0f bytes/game %8.0f games/MB %6.2f ns/game-tick", name,
+      bytes_per_game, 1048576.0 / bytes_per_game, ns / ticks);
+    if (misses) {
+      std::printf(" %6.3f misses/game-tick\n", double(*misses) / ticks);
+    } else {
+      std::printf("    n/a misses/game-tick\n");
+    }
+  };
+  std::printf("packed games: %d games stepped round robin\n", games);
+  cache_miss_counter_t counter;
+
+  std::vector<breakout_t> batch(games);
+  size_t batch_bytes = 0;
+  for (breakout_t& breakout : batch) {
+    breakout.setup(0, 0, 101, 30);
+    batch_bytes += breakout_bytes(breakout);
+  }
+  counter.start();
+  const double batch_ns = measure_ns(1, [&] {
+    for (int round = 0; round < rounds; ++round) {
+      for (breakout_t& breakout : batch) {
+        switch (breakout.state()) {
+          case breakout_t::game_state_e::preparing:
+            breakout.launch_left();
+            break;
+          case breakout_t::game_state_e::game_over:
+          case breakout_t::game_state_e::game_complete:
+            breakout.restart();
+            break;
+          default:
+            if (breakout.ball_position().x_ < breakout.paddle_position().x_) {
+              breakout.move_paddle_left(2);
+            } else {
+              breakout.move_paddle_right(2);
+            }
+        }
+        breakout.step();
+      }
+    }
+  });
+  report("breakout", double(batch_bytes) / games, batch_ns, counter.stop());
+
+  packed_games_t packed(batch.front(), games);
+  counter.start();
+  const double packed_ns = measure_ns(1, [&] {
+    for (int round = 0; round < rounds; ++round) {
+      for (int game = 0; game < games; ++game) {
+        const packed_game_t& g = packed.game(game);
+        switch (breakout_t::game_state_e(g.state_)) {
+          case breakout_t::game_state_e::preparing:
+            packed.launch_left(game);
+            break;
+          case breakout_t::game_state_e::game_over:
+          case breakout_t::game_state_e::game_complete:
+            packed.restart(game);
+            break;
+          default:
+            if (g.ball_x_ < g.paddle_x_[0]) {
+              packed.move_paddle_left(game, 2);
+            } else {
+              packed.move_paddle_right(game, 2);
+            }
+        }
+        packed.step(game);
+      }
+    }
+  });
+  report("packed", double(packed.bytes()) / games, packed_ns, counter.stop());
+}
+
+// games per second of the batch runner as threads are added
+void bench_batch_scaling() {
+  const int cores = std::max(int(std::thread::hardware_concurrency()), 1);
+  std::printf("batch runner: threads vs games per second (%d cores)\n", cores);
+  double single = 0.0;
+  for (int threads = 1; threads <= cores; threads *= 2) {
+    batch_config_t config;
+    config.games_ = 400 * uint64_t(threads);
+    config.threads_ = threads;
+    config.max_ticks_ = 20000;
+    const double ns = measure_ns(1, [&] {
+      run_batch(config, batch_autopilot_t{});
+    });
+    const double games_per_second = double(config.games_) / (ns / 1e9);
+    single = threads == 1 ? games_per_second : single;
+    std::printf(
+      "  %3d threads %10.0f games/s %6.2fx\n", threads, games_per_second,
+      games_per_second / single);
+  }
+}
+
+int main() {
+  bench_render_remaining_blocks();
+  bench_row_kernel();
+  bench_rasterize();
+  bench_render_layers();
+  bench_trajectory_cache();
+  bench_step_n();
+  bench_packed_games();
+  bench_restart();
+  bench_batch_scaling();
+  return 0;
+}
@@ -1,10 +1,20 @@
 #pragma once
 
 #include <algorithm>
-#include <deque>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <string_view>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "counter_rng.h"
+#include "row_kernel.h"
 
 struct vec2 {
   int x_;
@@ -42,6 +52,63 @@ struct ball_t {
   vec2 velocity_;
 };
 
+// number of blocks in a row held by each chunk
+constexpr int block_chunk_size = 64;
+
+// a fixed size run of blocks in a row, with a bit set for each block still
+// alive and a count of them (empty chunks are skipped when scanning)
+struct block_chunk_t {
+  uint64_t alive_;
+  int count_;
+};
+
+// inclusive range of cells (board space) a block can be hit in
+struct cell_rect_t {
+  vec2 min_;
+  vec2 max_;
+};
+
+// storage used for the block ids of a cell map (int16 halves the memory of
+// int32 but can only address 32767 blocks)
+enum class cell_map_width_e { none, int16, int32 };
+
+// side of the square of cells each bucket of a moved cell map covers
+constexpr int cell_map_bucket_size = 16;
+
+// optional map from each playfield cell to the id of the live block covering
+// it (-1 for none), so finding the block under the ball is a single load
+struct block_cell_map_t {
+  cell_map_width_e width_ = cell_map_width_e::none;
+  vec2 size_ = {0, 0};
+  std::vector<int16_t> cells16_;
+  std::vector<int32_t> cells32_;
+  std::vector<cell_rect_t> rects_; // cells covered by each block id
+  bool moved_ = false; // a rect was moved off the grid by set_block_cells
+  // once moved, the ids of the blocks whose rect covers cells of each bucket
+  // (row by row), so the blocks a rect overlaps are found without a scan
+  int bucket_cols_ = 0;
+  std::vector<std::vector<int>> buckets_;
+};
+
+// node of a bounding volume hierarchy over free-form block rects
+struct block_bvh_node_t {
+  cell_rect_t bounds_;
+  int first_; // first child (inner node) or first entry in block_ids_ (leaf)
+  int count_; // number of blocks in a leaf, 0 for an inner node
+  int parent_;
+  int alive_; // live blocks in the subtree, pruned from queries once zero
+};
+
+// static hierarchy built once when a free-form level is loaded
+struct block_bvh_t {
+  std::vector<block_bvh_node_t> nodes_; // root first, children after parents
+  std::vector<int> block_ids_; // block ids grouped by leaf
+  std::vector<int> leaves_; // leaf node holding each block id
+};
+
+// maximum blocks held by a bvh leaf
+constexpr int block_bvh_leaf_size = 4;
+
 struct blocks_t {
   int col_margin;
   int row_margin;
@@ -52,9 +119,37 @@ struct blocks_t {
   int block_height;
   int block_width;
 
-  std::deque<bool> destroyed_;
+  int chunks_per_row_;
+  int remaining_;
+  std::vector<block_chunk_t> chunks_;
+  std::vector<int> row_counts_; // blocks alive in each row
+  std::vector<uint64_t> live_rows_; // bit set for each row with blocks alive
+  // every block id (row * col_count + col), the first remaining_ of which are
+  // alive, followed by destroyed blocks (most recently destroyed first)
+  std::vector<int> block_ids_;
+  std::vector<int> block_id_index_; // position of each block id in block_ids_
+  block_cell_map_t cell_map_;
+  // free-form levels give every block its own rect (a single row of blocks)
+  // instead of using the uniform grid, and look them up through bvh_
+  std::vector<cell_rect_t> rects_;
+  block_bvh_t bvh_;
+  const row_kernel_t* row_kernel_ = &row_kernel(); // see find_row_hit
 };
 
+// number of rows summarised by each word of blocks_t::live_rows_
+constexpr int live_rows_per_word = 64;
+
+// index of the lowest set bit (value must not be zero)
+int lowest_set_bit(const uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
 bool intersects(const paddle_t& paddle, const ball_t& ball) {
   if (
     ball.position_.x_ >= paddle.left_edge()
@@ -66,41 +161,768 @@ bool intersects(const paddle_t& paddle, const ball_t& ball) {
   return false;
 }
 
+block_chunk_t& block_chunk(blocks_t& blocks, const int col, const int row) {
+  return blocks
+    .chunks_[row * blocks.chunks_per_row_ + col / block_chunk_size];
+}
+
+const block_chunk_t& block_chunk(
+  const blocks_t& blocks, const int col, const int row) {
+  return blocks
+    .chunks_[row * blocks.chunks_per_row_ + col / block_chunk_size];
+}
+
+uint64_t block_chunk_bit(const int col) {
+  return uint64_t(1) << (col % block_chunk_size);
+}
+
+int block_id(const blocks_t& blocks, const int col, const int row) {
+  return row * blocks.col_count + col;
+}
+
 bool block_destroyed(const blocks_t& blocks, const int col, const int row) {
-  return blocks.destroyed_[row * blocks.col_count + col];
+  return (block_chunk(blocks, col, row).alive_ & block_chunk_bit(col)) == 0;
+}
+
+int cell_map_owner(const block_cell_map_t& map, const int index) {
+  return map.width_ == cell_map_width_e::int16 ? map.cells16_[index]
+                                               : map.cells32_[index];
+}
+
+int cell_map_block(const block_cell_map_t& map, const vec2 cell) {
+  if (
+    cell.x_ < 0 || cell.y_ < 0 || cell.x_ >= map.size_.x_
+    || cell.y_ >= map.size_.y_) {
+    return -1;
+  }
+  return cell_map_owner(map, cell.y_ * map.size_.x_ + cell.x_);
+}
+
+void set_cell_map_block(block_cell_map_t& map, const int index, const int id) {
+  if (map.width_ == cell_map_width_e::int16) {
+    map.cells16_[index] = static_cast<int16_t>(id);
+  } else {
+    map.cells32_[index] = id;
+  }
+}
+
+// memory used by the cell map in bytes
+[[nodiscard]] size_t cell_map_bytes(const block_cell_map_t& map) {
+  size_t bucket_bytes = 0;
+  for (const auto& bucket : map.buckets_) {
+    bucket_bytes += bucket.size() * sizeof(int);
+  }
+  return map.cells16_.size() * sizeof(int16_t)
+       + map.cells32_.size() * sizeof(int32_t)
+       + map.rects_.size() * sizeof(cell_rect_t) + bucket_bytes;
+}
+
+bool contains(const cell_rect_t& rect, const vec2 cell) {
+  return cell.x_ >= rect.min_.x_ && cell.x_ <= rect.max_.x_
+      && cell.y_ >= rect.min_.y_ && cell.y_ <= rect.max_.y_;
+}
+
+// cells a block can be hit in (matches intersects)
+cell_rect_t block_cell_rect(
+  const blocks_t& blocks, const int col, const int row) {
+  if (!blocks.rects_.empty()) {
+    return blocks.rects_[block_id(blocks, col, row)];
+  }
+  const int block_x =
+    blocks.col_margin + ((blocks.block_width + blocks.col_spacing) * col);
+  const int block_y =
+    blocks.row_margin + ((blocks.block_height + blocks.row_spacing) * row);
+  return cell_rect_t{
+    vec2{block_x, block_y}, vec2{block_x + blocks.block_width, block_y}};
+}
+
+// cells a block is drawn in (matches display_blocks), on the grid a column
+// fewer than it can be hit in so neighbouring blocks show a gap, a block
+// moved off the grid is drawn as the rect it was moved to
+cell_rect_t block_drawn_rect(
+  const blocks_t& blocks, const int col, const int row) {
+  cell_rect_t rect = block_cell_rect(blocks, col, row);
+  if (blocks.rects_.empty()) {
+    const auto& map = blocks.cell_map_;
+    if (map.moved_) {
+      const cell_rect_t& moved = map.rects_[block_id(blocks, col, row)];
+      if (!(moved.min_ == rect.min_) || !(moved.max_ == rect.max_)) {
+        return moved;
+      }
+    }
+    rect.max_.x_--;
+  }
+  return rect;
+}
+
+// visits each bucket holding cells of rect inside the map
+template<typename Fn>
+void for_each_cell_bucket(
+  const block_cell_map_t& map, const cell_rect_t& rect, Fn&& fn) {
+  const int min_x = std::max(rect.min_.x_, 0);
+  const int min_y = std::max(rect.min_.y_, 0);
+  const int max_x = std::min(rect.max_.x_, map.size_.x_ - 1);
+  const int max_y = std::min(rect.max_.y_, map.size_.y_ - 1);
+  if (min_x > max_x || min_y > max_y) {
+    return;
+  }
+  for (int y = min_y / cell_map_bucket_size; y <= max_y / cell_map_bucket_size;
+       ++y) {
+    for (int x = min_x / cell_map_bucket_size;
+         x <= max_x / cell_map_bucket_size; ++x) {
+      fn(y * map.bucket_cols_ + x);
+    }
+  }
+}
+
+void add_block_to_buckets(block_cell_map_t& map, const int id) {
+  for_each_cell_bucket(map, map.rects_[id], [&map, id](const int bucket) {
+    map.buckets_[bucket].push_back(id);
+  });
+}
+
+void remove_block_from_buckets(block_cell_map_t& map, const int id) {
+  for_each_cell_bucket(map, map.rects_[id], [&map, id](const int bucket) {
+    auto& ids = map.buckets_[bucket];
+    ids.erase(std::find(ids.begin(), ids.end(), id));
+  });
+}
+
+// files every block rect into the buckets, done once a rect is first moved
+void build_cell_buckets(block_cell_map_t& map) {
+  map.bucket_cols_ =
+    (map.size_.x_ + cell_map_bucket_size - 1) / cell_map_bucket_size;
+  const int bucket_rows =
+    (map.size_.y_ + cell_map_bucket_size - 1) / cell_map_bucket_size;
+  map.buckets_.assign(size_t(map.bucket_cols_) * bucket_rows, {});
+  for (int id = 0; id < int(map.rects_.size()); ++id) {
+    add_block_to_buckets(map, id);
+  }
+}
+
+// visits the index of each cell of the block's rect inside the map
+template<typename Fn>
+void for_each_block_cell(const block_cell_map_t& map, const int id, Fn&& fn) {
+  const cell_rect_t& rect = map.rects_[id];
+  for (int y = std::max(rect.min_.y_, 0);
+       y <= std::min(rect.max_.y_, map.size_.y_ - 1); ++y) {
+    for (int x = std::max(rect.min_.x_, 0);
+         x <= std::min(rect.max_.x_, map.size_.x_ - 1); ++x) {
+      fn(y * map.size_.x_ + x);
+    }
+  }
+}
+
+// claims the cells of the block's rect, where blocks overlap the lowest id
+// owns the cell (the first block the row by row scan would find)
+void paint_block_cells(block_cell_map_t& map, const int id) {
+  for_each_block_cell(map, id, [&map, id](const int index) {
+    if (const int owner = cell_map_owner(map, index);
+        owner == -1 || owner > id) {
+      set_cell_map_block(map, index, id);
+    }
+  });
+}
+
+bool overlaps(const cell_rect_t& a, const cell_rect_t& b) {
+  return a.min_.x_ <= b.max_.x_ && b.min_.x_ <= a.max_.x_
+      && a.min_.y_ <= b.max_.y_ && b.min_.y_ <= a.max_.y_;
+}
+
+// releases the cells owned by the block, handing any it overlapped with a
+// live block back to that block (on the grid only a neighbour in the same
+// row can overlap, once a rect was moved any block in the buckets the rect
+// covers can)
+void clear_block_cells(blocks_t& blocks, const int col, const int row) {
+  auto& map = blocks.cell_map_;
+  const int id = block_id(blocks, col, row);
+  for_each_block_cell(map, id, [&map, id](const int index) {
+    if (cell_map_owner(map, index) == id) {
+      set_cell_map_block(map, index, -1);
+    }
+  });
+  if (map.moved_) {
+    const cell_rect_t cleared = map.rects_[id];
+    for_each_cell_bucket(map, cleared, [&](const int bucket) {
+      for (const int other : map.buckets_[bucket]) {
+        const int other_col = other % blocks.col_count;
+        const int other_row = other / blocks.col_count;
+        if (
+          other != id && overlaps(map.rects_[other], cleared)
+          && !block_destroyed(blocks, other_col, other_row)) {
+          paint_block_cells(map, other);
+        }
+      }
+    });
+    return;
+  }
+  for (const int neighbour : {col - 1, col + 1}) {
+    if (
+      neighbour >= 0 && neighbour < blocks.col_count
+      && !block_destroyed(blocks, neighbour, row)) {
+      paint_block_cells(map, block_id(blocks, neighbour, row));
+    }
+  }
+}
+
+// fills the cell map from the block rects, skipping destroyed blocks
+void repaint_cell_map(blocks_t& blocks) {
+  auto& map = blocks.cell_map_;
+  if (map.width_ == cell_map_width_e::int16) {
+    map.cells16_.assign(map.size_.x_ * map.size_.y_, -1);
+  } else {
+    map.cells32_.assign(map.size_.x_ * map.size_.y_, -1);
+  }
+  for (int id = 0; id < int(map.rects_.size()); ++id) {
+    const int col = id % blocks.col_count;
+    const int row = id / blocks.col_count;
+    if (!block_destroyed(blocks, col, row)) {
+      paint_block_cells(map, id);
+    }
+  }
+}
+
+// builds a cell map covering size cells from the uniform block layout (int16
+// is widened to int32 if there are too many blocks to address)
+void build_cell_map(
+  blocks_t& blocks, const vec2 size, cell_map_width_e width) {
+  const int block_count = blocks.col_count * blocks.row_count;
+  if (width == cell_map_width_e::int16 && block_count > INT16_MAX) {
+    width = cell_map_width_e::int32;
+  }
+  auto& map = blocks.cell_map_;
+  // cleared rather than replaced so a rebuild reuses the storage
+  map.width_ = cell_map_width_e::none;
+  map.size_ = {0, 0};
+  map.cells16_.clear();
+  map.cells32_.clear();
+  map.rects_.clear();
+  map.moved_ = false;
+  map.bucket_cols_ = 0;
+  map.buckets_.clear();
+  if (width == cell_map_width_e::none) {
+    return;
+  }
+  map.width_ = width;
+  map.size_ = size;
+  map.rects_.resize(block_count);
+  for (int id = 0; id < block_count; ++id) {
+    map.rects_[id] =
+      block_cell_rect(blocks, id % blocks.col_count, id / blocks.col_count);
+  }
+  repaint_cell_map(blocks);
+}
+
+// moves a block to cover an arbitrary rect of cells (for irregular layouts)
+void set_block_cells(
+  blocks_t& blocks, const int col, const int row, const cell_rect_t& rect) {
+  auto& map = blocks.cell_map_;
+  if (!map.moved_) {
+    map.moved_ = true;
+    build_cell_buckets(map);
+  }
+  const int id = block_id(blocks, col, row);
+  if (!block_destroyed(blocks, col, row)) {
+    clear_block_cells(blocks, col, row);
+  }
+  remove_block_from_buckets(map, id);
+  map.rects_[id] = rect;
+  add_block_to_buckets(map, id);
+  if (!block_destroyed(blocks, col, row)) {
+    paint_block_cells(map, id);
+  }
+}
+
+// fills in node from the blocks in bvh.block_ids_[begin, end), splitting them
+// at the median centre along the longest axis until they fit in a leaf
+void build_block_bvh_node(
+  const std::vector<cell_rect_t>& rects, block_bvh_t& bvh, const int node,
+  const int begin, const int end) {
+  cell_rect_t bounds = rects[bvh.block_ids_[begin]];
+  for (int i = begin + 1; i < end; ++i) {
+    const cell_rect_t& rect = rects[bvh.block_ids_[i]];
+    bounds.min_.x_ = std::min(bounds.min_.x_, rect.min_.x_);
+    bounds.min_.y_ = std::min(bounds.min_.y_, rect.min_.y_);
+    bounds.max_.x_ = std::max(bounds.max_.x_, rect.max_.x_);
+    bounds.max_.y_ = std::max(bounds.max_.y_, rect.max_.y_);
+  }
+  bvh.nodes_[node].bounds_ = bounds;
+
+  if (end - begin <= block_bvh_leaf_size) {
+    bvh.nodes_[node].first_ = begin;
+    bvh.nodes_[node].count_ = end - begin;
+    for (int i = begin; i < end; ++i) {
+      bvh.leaves_[bvh.block_ids_[i]] = node;
+    }
+    return;
+  }
+
+  const bool split_x =
+    bounds.max_.x_ - bounds.min_.x_ >= bounds.max_.y_ - bounds.min_.y_;
+  const auto centre = [&rects, split_x](const int id) {
+    const cell_rect_t& rect = rects[id];
+    return split_x ? rect.min_.x_ + rect.max_.x_ : rect.min_.y_ + rect.max_.y_;
+  };
+  const int middle = begin + (end - begin) / 2;
+  std::nth_element(
+    bvh.block_ids_.begin() + begin, bvh.block_ids_.begin() + middle,
+    bvh.block_ids_.begin() + end, [&centre](const int lhs, const int rhs) {
+      return centre(lhs) < centre(rhs);
+    });
+
+  // children are allocated together so the second is always first_ + 1
+  const int first = int(bvh.nodes_.size());
+  bvh.nodes_.push_back(block_bvh_node_t{{}, 0, 0, node, 0});
+  bvh.nodes_.push_back(block_bvh_node_t{{}, 0, 0, node, 0});
+  bvh.nodes_[node].first_ = first;
+  bvh.nodes_[node].count_ = 0;
+  build_block_bvh_node(rects, bvh, first, begin, middle);
+  build_block_bvh_node(rects, bvh, first + 1, middle, end);
+}
+
+// recounts the live blocks under each node (children come after parents so
+// walking backwards visits children first)
+void reset_block_bvh_alive(blocks_t& blocks) {
+  auto& nodes = blocks.bvh_.nodes_;
+  for (int node = int(nodes.size()) - 1; node >= 0; --node) {
+    if (nodes[node].count_ > 0) {
+      nodes[node].alive_ = 0;
+      for (int i = 0; i < nodes[node].count_; ++i) {
+        const int id = blocks.bvh_.block_ids_[nodes[node].first_ + i];
+        nodes[node].alive_ += block_destroyed(blocks, id, 0) ? 0 : 1;
+      }
+    } else {
+      nodes[node].alive_ =
+        nodes[nodes[node].first_].alive_ + nodes[nodes[node].first_ + 1].alive_;
+    }
+  }
+}
+
+void build_block_bvh(blocks_t& blocks) {
+  auto& bvh = blocks.bvh_;
+  const int block_count = int(blocks.rects_.size());
+  bvh.nodes_.clear();
+  bvh.block_ids_.resize(block_count);
+  bvh.leaves_.resize(block_count);
+  if (block_count == 0) {
+    return;
+  }
+  for (int id = 0; id < block_count; ++id) {
+    bvh.block_ids_[id] = id;
+  }
+  bvh.nodes_.push_back(block_bvh_node_t{{}, 0, 0, -1, 0});
+  build_block_bvh_node(blocks.rects_, bvh, 0, 0, block_count);
+  reset_block_bvh_alive(blocks);
+}
+
+// lowest id of the live free-form blocks containing the cell (or -1),
+// skipping subtrees that miss the cell or have been cleared
+int find_block_bvh(const blocks_t& blocks, const vec2 cell) {
+  const auto& bvh = blocks.bvh_;
+  if (bvh.nodes_.empty()) {
+    return -1;
+  }
+  int found = -1;
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const block_bvh_node_t& node = bvh.nodes_[stack[--top]];
+    if (node.alive_ == 0 || !contains(node.bounds_, cell)) {
+      continue;
+    }
+    if (node.count_ == 0) {
+      stack[top++] = node.first_;
+      stack[top++] = node.first_ + 1;
+      continue;
+    }
+    for (int i = 0; i < node.count_; ++i) {
+      const int id = bvh.block_ids_[node.first_ + i];
+      if (
+        (found == -1 || id < found) && contains(blocks.rects_[id], cell)
+        && !block_destroyed(blocks, id, 0)) {
+        found = id;
+      }
+    }
+  }
+  return found;
+}
+
+// (re)populates the chunks from the block dimensions with every block alive
+void reset_blocks(blocks_t& blocks) {
+  blocks.chunks_per_row_ =
+    (blocks.col_count + block_chunk_size - 1) / block_chunk_size;
+  blocks.remaining_ = blocks.col_count * blocks.row_count;
+  blocks.chunks_.resize(blocks.chunks_per_row_ * blocks.row_count);
+  blocks.row_counts_.assign(blocks.row_count, blocks.col_count);
+  blocks.live_rows_.assign(
+    (blocks.row_count + live_rows_per_word - 1) / live_rows_per_word, 0);
+  blocks.block_ids_.resize(blocks.remaining_);
+  blocks.block_id_index_.resize(blocks.remaining_);
+  for (int id = 0; id < blocks.remaining_; ++id) {
+    blocks.block_ids_[id] = id;
+    blocks.block_id_index_[id] = id;
+  }
+  for (int row = 0; row < blocks.row_count; ++row) {
+    for (int chunk = 0; chunk < blocks.chunks_per_row_; ++chunk) {
+      const int count =
+        std::min(block_chunk_size, blocks.col_count - chunk * block_chunk_size);
+      blocks.chunks_[row * blocks.chunks_per_row_ + chunk] = block_chunk_t{
+        count == block_chunk_size ? ~uint64_t(0)
+                                  : (uint64_t(1) << count) - 1,
+        count};
+    }
+    if (blocks.col_count > 0) {
+      blocks.live_rows_[row / live_rows_per_word] |=
+        uint64_t(1) << (row % live_rows_per_word);
+    }
+  }
+  if (blocks.cell_map_.width_ != cell_map_width_e::none) {
+    repaint_cell_map(blocks);
+  }
+  reset_block_bvh_alive(blocks);
 }
 
 void destroy_block(blocks_t& blocks, const int col, const int row) {
-  blocks.destroyed_[row * blocks.col_count + col] = true;
+  auto& chunk = block_chunk(blocks, col, row);
+  if (const uint64_t bit = block_chunk_bit(col); (chunk.alive_ & bit) != 0) {
+    chunk.alive_ &= ~bit;
+    chunk.count_--;
+    // swap the block with the last alive block so alive blocks stay dense
+    const int id = block_id(blocks, col, row);
+    const int index = blocks.block_id_index_[id];
+    const int last_index = --blocks.remaining_;
+    const int last_id = blocks.block_ids_[last_index];
+    blocks.block_ids_[index] = last_id;
+    blocks.block_id_index_[last_id] = index;
+    blocks.block_ids_[last_index] = id;
+    blocks.block_id_index_[id] = last_index;
+    if (--blocks.row_counts_[row] == 0) {
+      blocks.live_rows_[row / live_rows_per_word] &=
+        ~(uint64_t(1) << (row % live_rows_per_word));
+    }
+    if (blocks.cell_map_.width_ != cell_map_width_e::none) {
+      clear_block_cells(blocks, col, row);
+    }
+    if (!blocks.bvh_.nodes_.empty()) {
+      for (int node = blocks.bvh_.leaves_[id]; node != -1;
+           node = blocks.bvh_.nodes_[node].parent_) {
+        blocks.bvh_.nodes_[node].alive_--;
+      }
+    }
+  }
 }
 
-std::optional<lookup_t> intersects(const blocks_t& blocks, const ball_t& ball) {
-  for (int row = 0; row < blocks.row_count; row++) {
-    for (int col = 0; col < blocks.col_count; col++) {
-      if (block_destroyed(blocks, col, row)) {
+// brings a destroyed block back to life (the inverse of destroy_block)
+void restore_block(blocks_t& blocks, const int col, const int row) {
+  auto& chunk = block_chunk(blocks, col, row);
+  if (const uint64_t bit = block_chunk_bit(col); (chunk.alive_ & bit) == 0) {
+    chunk.alive_ |= bit;
+    chunk.count_++;
+    // swap the block with the first destroyed block and grow the alive range
+    // to include it
+    const int id = block_id(blocks, col, row);
+    const int index = blocks.block_id_index_[id];
+    const int first_index = blocks.remaining_++;
+    const int first_id = blocks.block_ids_[first_index];
+    blocks.block_ids_[index] = first_id;
+    blocks.block_id_index_[first_id] = index;
+    blocks.block_ids_[first_index] = id;
+    blocks.block_id_index_[id] = first_index;
+    if (blocks.row_counts_[row]++ == 0) {
+      blocks.live_rows_[row / live_rows_per_word] |=
+        uint64_t(1) << (row % live_rows_per_word);
+    }
+    if (blocks.cell_map_.width_ != cell_map_width_e::none) {
+      paint_block_cells(blocks.cell_map_, id);
+    }
+    if (!blocks.bvh_.nodes_.empty()) {
+      for (int node = blocks.bvh_.leaves_[id]; node != -1;
+           node = blocks.bvh_.nodes_[node].parent_) {
+        blocks.bvh_.nodes_[node].alive_++;
+      }
+    }
+  }
+}
+
+// restores the most recently destroyed blocks until remaining are alive
+void restore_blocks(blocks_t& blocks, const int remaining) {
+  while (blocks.remaining_ < remaining) {
+    const int id = blocks.block_ids_[blocks.remaining_];
+    restore_block(blocks, id % blocks.col_count, id / blocks.col_count);
+  }
+}
+
+// whether two sets of blocks share the dimensions of their grid
+bool same_block_dimensions(const blocks_t& lhs, const blocks_t& rhs) {
+  return lhs.col_margin == rhs.col_margin && lhs.row_margin == rhs.row_margin
+      && lhs.col_spacing == rhs.col_spacing
+      && lhs.row_spacing == rhs.row_spacing && lhs.col_count == rhs.col_count
+      && lhs.row_count == rhs.row_count
+      && lhs.block_height == rhs.block_height
+      && lhs.block_width == rhs.block_width;
+}
+
+bool same_block_rects(
+  const std::vector<cell_rect_t>& lhs, const std::vector<cell_rect_t>& rhs) {
+  return std::equal(
+    lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+    [](const cell_rect_t& a, const cell_rect_t& b) {
+      return a.min_ == b.min_ && a.max_ == b.max_;
+    });
+}
+
+void set_block_dimensions(blocks_t& blocks, const blocks_t& dimensions) {
+  blocks.col_margin = dimensions.col_margin;
+  blocks.row_margin = dimensions.row_margin;
+  blocks.col_spacing = dimensions.col_spacing;
+  blocks.row_spacing = dimensions.row_spacing;
+  blocks.col_count = dimensions.col_count;
+  blocks.row_count = dimensions.row_count;
+  blocks.block_height = dimensions.block_height;
+  blocks.block_width = dimensions.block_width;
+}
+
+// lays the blocks out afresh once their dimensions or rects have changed,
+// in the storage they already have (rebuilding the bvh of a free-form level
+// and the cell map, if there is one, over the new layout)
+void relayout_blocks(blocks_t& blocks) {
+  const cell_map_width_e width = blocks.cell_map_.width_;
+  blocks.cell_map_.width_ = cell_map_width_e::none;
+  blocks.bvh_.nodes_.clear();
+  reset_blocks(blocks);
+  if (blocks.rects_.empty()) {
+    blocks.bvh_.block_ids_.clear();
+    blocks.bvh_.leaves_.clear();
+  } else {
+    build_block_bvh(blocks);
+  }
+  if (width != cell_map_width_e::none) {
+    build_cell_map(blocks, blocks.cell_map_.size_, width);
+  }
+}
+
+// the dimensions of a free-form level of count blocks
+blocks_t free_form_dimensions(const int count) {
+  blocks_t dimensions{};
+  dimensions.col_count = count;
+  dimensions.row_count = 1;
+  return dimensions;
+}
+
+// lays a free-form level out into blocks (one block per rect, as a single
+// row of blocks) reusing their storage, blocks already holding the level
+// only have every block brought back
+void layout_free_form_blocks(
+  const std::vector<cell_rect_t>& rects, blocks_t& blocks) {
+  const blocks_t dimensions = free_form_dimensions(int(rects.size()));
+  if (
+    same_block_dimensions(dimensions, blocks)
+    && same_block_rects(rects, blocks.rects_) && !blocks.cell_map_.moved_) {
+    reset_blocks(blocks);
+    return;
+  }
+  set_block_dimensions(blocks, dimensions);
+  blocks.rects_.assign(rects.begin(), rects.end());
+  relayout_blocks(blocks);
+}
+
+// creates a free-form level, one block per rect (as a single row of blocks)
+blocks_t create_free_form_blocks(const std::vector<cell_rect_t>& rects) {
+  blocks_t blocks{};
+  layout_free_form_blocks(rects, blocks);
+  return blocks;
+}
+
+// the smallest rect covering the cells of every block, alive or not (min_
+// past max_ when there are no blocks), blocks moved in the cell map count
+// where they were moved to
+cell_rect_t block_layout_bounds(const blocks_t& blocks) {
+  const auto& map = blocks.cell_map_;
+  cell_rect_t bounds = {vec2{0, 0}, vec2{-1, -1}};
+  for (int row = 0; row < blocks.row_count; ++row) {
+    for (int col = 0; col < blocks.col_count; ++col) {
+      const cell_rect_t rect = map.moved_
+                               ? map.rects_[block_id(blocks, col, row)]
+                               : block_cell_rect(blocks, col, row);
+      if (bounds.min_.x_ > bounds.max_.x_) {
+        bounds = rect;
         continue;
       }
-      const int block_x =
-        blocks.col_margin + ((blocks.block_width + blocks.col_spacing) * col);
-      const int block_y =
-        blocks.row_margin + ((blocks.block_height + blocks.row_spacing) * row);
-      if (
-        ball.position_.x_ >= block_x
-        && ball.position_.x_ <= block_x + blocks.block_width
-        && ball.position_.y_ == block_y) {
-        return lookup_t{col, row};
+      bounds.min_.x_ = std::min(bounds.min_.x_, rect.min_.x_);
+      bounds.min_.y_ = std::min(bounds.min_.y_, rect.min_.y_);
+      bounds.max_.x_ = std::max(bounds.max_.x_, rect.max_.x_);
+      bounds.max_.y_ = std::max(bounds.max_.y_, rect.max_.y_);
+    }
+  }
+  return bounds;
+}
+
+// whether two sets of blocks are laid out alike (whichever are alive),
+// including any blocks moved in their cell maps
+bool same_block_layout(const blocks_t& lhs, const blocks_t& rhs) {
+  return same_block_dimensions(lhs, rhs)
+      && same_block_rects(lhs.rects_, rhs.rects_)
+      && lhs.cell_map_.moved_ == rhs.cell_map_.moved_
+      && (!lhs.cell_map_.moved_
+          || same_block_rects(lhs.cell_map_.rects_, rhs.cell_map_.rects_));
+}
+
+[[nodiscard]] int blocks_remaining(const blocks_t& blocks) {
+  return blocks.remaining_;
+}
+
+// calls fn(col, row) for each block still alive (in no particular order)
+template<typename Fn>
+void for_each_live_block(const blocks_t& blocks, Fn&& fn) {
+  for (int index = 0; index < blocks.remaining_; ++index) {
+    const int id = blocks.block_ids_[index];
+    fn(id % blocks.col_count, id / blocks.col_count);
+  }
+}
+
+// calls fn(row) for each row with blocks still alive (top to bottom) and
+// stops as soon as fn returns true
+template<typename Fn>
+bool find_live_row(const blocks_t& blocks, Fn&& fn) {
+  for (int word = 0; word < int(blocks.live_rows_.size()); ++word) {
+    for (uint64_t rows = blocks.live_rows_[word]; rows != 0; rows &= rows - 1) {
+      if (fn(word * live_rows_per_word + lowest_set_bit(rows))) {
+        return true;
       }
     }
   }
-  return {};
+  return false;
+}
+
+// extents of the run of blocks held by a chunk of a row
+row_extents_t chunk_extents(const blocks_t& blocks, const int chunk) {
+  const int stride = blocks.block_width + blocks.col_spacing;
+  return row_extents_t{
+    blocks.col_margin + stride * chunk * block_chunk_size, stride,
+    blocks.block_width,
+    std::min(block_chunk_size, blocks.col_count - chunk * block_chunk_size)};
+}
+
+// first live block in the row whose extent contains x (or -1), testing a
+// chunk of blocks at a time with the row kernel
+int find_row_hit(const blocks_t& blocks, const int row, const int x) {
+  const row_hit_mask_fn_t hit_mask = blocks.row_kernel_->hit_mask_;
+  const block_chunk_t* chunks = &blocks.chunks_[row * blocks.chunks_per_row_];
+  for (int chunk = 0; chunk < blocks.chunks_per_row_; ++chunk) {
+    if (chunks[chunk].count_ == 0) {
+      continue;
+    }
+    if (const uint64_t hits =
+          hit_mask(chunk_extents(blocks, chunk), x) & chunks[chunk].alive_;
+        hits != 0) {
+      return chunk * block_chunk_size + lowest_set_bit(hits);
+    }
+  }
+  return -1;
+}
+
+std::optional<lookup_t> intersects(const blocks_t& blocks, const ball_t& ball) {
+  if (blocks.cell_map_.width_ != cell_map_width_e::none) {
+    if (const int id = cell_map_block(blocks.cell_map_, ball.position_);
+        id != -1) {
+      return lookup_t{id % blocks.col_count, id / blocks.col_count};
+    }
+    return {};
+  }
+  if (!blocks.rects_.empty()) {
+    if (const int id = find_block_bvh(blocks, ball.position_); id != -1) {
+      return lookup_t{id, 0};
+    }
+    return {};
+  }
+  std::optional<lookup_t> lookup;
+  find_live_row(blocks, [&](const int row) {
+    const int block_y =
+      blocks.row_margin + ((blocks.block_height + blocks.row_spacing) * row);
+    if (ball.position_.y_ != block_y) {
+      return false;
+    }
+    if (const int col = find_row_hit(blocks, row, ball.position_.x_);
+        col != -1) {
+      lookup = lookup_t{col, row};
+      return true;
+    }
+    return false;
+  });
+  return lookup;
+}
+
+// intersects for many balls at once, each chunk of a row is tested against
+// all the balls level with it by the row kernel
+void intersects(
+  const blocks_t& blocks, const ball_t* balls, const int ball_count,
+  std::optional<lookup_t>* lookups) {
+  if (
+    blocks.cell_map_.width_ != cell_map_width_e::none
+    || !blocks.rects_.empty()) {
+    for (int i = 0; i < ball_count; ++i) {
+      lookups[i] = intersects(blocks, balls[i]);
+    }
+    return;
+  }
+  std::fill(lookups, lookups + ball_count, std::nullopt);
+  const row_hit_masks_fn_t hit_masks = blocks.row_kernel_->hit_masks_;
+  constexpr int batch_size = 16;
+  find_live_row(blocks, [&](const int row) {
+    const int block_y =
+      blocks.row_margin + ((blocks.block_height + blocks.row_spacing) * row);
+    for (int first = 0; first < ball_count;) {
+      // gather the next batch of balls level with the row
+      int xs[batch_size];
+      int indices[batch_size];
+      int count = 0;
+      for (; first < ball_count && count < batch_size; ++first) {
+        if (balls[first].position_.y_ == block_y && !lookups[first]) {
+          xs[count] = balls[first].position_.x_;
+          indices[count++] = first;
+        }
+      }
+      const block_chunk_t* chunks =
+        &blocks.chunks_[row * blocks.chunks_per_row_];
+      for (int chunk = 0; chunk < blocks.chunks_per_row_ && count > 0;
+           ++chunk) {
+        if (chunks[chunk].count_ == 0) {
+          continue;
+        }
+        uint64_t masks[batch_size];
+        hit_masks(chunk_extents(blocks, chunk), xs, count, masks);
+        for (int i = 0; i < count; ++i) {
+          const int ball = indices[i];
+          if (const uint64_t hits = masks[i] & chunks[chunk].alive_;
+              hits != 0 && !lookups[ball]) {
+            lookups[ball] = lookup_t{
+              chunk * block_chunk_size + lowest_set_bit(hits), row};
+          }
+        }
+      }
+    }
+    return false;
+  });
 }
 
-void step(const paddle_t& paddle, ball_t& ball) {
+// moves the ball, bouncing it off the first of the paddles it reaches,
+// returns which paddle that was (-1 for none)
+int step(const paddle_t* paddles, const int paddle_count, ball_t& ball) {
   ball.position_.x_ += ball.velocity_.x_;
   ball.position_.y_ += ball.velocity_.y_;
-  if (intersects(paddle, ball)) {
-    ball.velocity_.y_ *= -1;
+  const paddle_t* hit = std::find_if(
+    paddles, paddles + paddle_count,
+    [&ball](const auto& paddle) { return intersects(paddle, ball); });
+  if (hit == paddles + paddle_count) {
+    return -1;
   }
+  ball.velocity_.y_ *= -1;
+  return int(hit - paddles);
+}
+
+int step(const paddle_t& paddle, ball_t& ball) {
+  return step(&paddle, 1, ball);
 }
 
 bool block_bounce(blocks_t& blocks, ball_t& ball) {
@@ -118,6 +940,12 @@ std::optional<vec2> block_position(const blocks_t& blocks, int col, int row) {
     return {};
   }
 
+  if (!blocks.rects_.empty()) {
+    const cell_rect_t& rect = blocks.rects_[block_id(blocks, col, row)];
+    return vec2{
+      (rect.min_.x_ + rect.max_.x_) / 2, (rect.min_.y_ + rect.max_.y_) / 2};
+  }
+
   return vec2{
     blocks.col_margin + ((blocks.block_width - 1) / 2)
       + ((blocks.block_width + blocks.col_spacing) * col),
@@ -125,28 +953,251 @@ std::optional<vec2> block_position(const blocks_t& blocks, int col, int row) {
       + ((blocks.block_height + blocks.row_spacing) * row)};
 }
 
+// draws to a display_t with string glyphs or to anything else with an
+// output(x, y, glyph) taking glyphs of its own (such as interned glyph ids)
+template<typename output_t, typename glyph_t>
 void display_blocks(
-  const blocks_t& blocks, vec2 offset, display_t& display,
-  std::string_view glyph) {
-  for (int row = 0; row < blocks.row_count; ++row) {
-    for (int col = 0; col < blocks.col_count; ++col) {
-      if (block_destroyed(blocks, col, row)) {
-        continue;
-      }
-      for (int block_part = 0; block_part < blocks.block_width; ++block_part) {
-        display.output(
-          offset.x_ + blocks.col_margin + block_part
-            + ((blocks.block_width + blocks.col_spacing) * col),
-          offset.y_ + blocks.row_margin
-            + ((blocks.block_height + blocks.row_spacing) * row),
-          glyph);
+  const blocks_t& blocks, vec2 offset, output_t& display, glyph_t glyph) {
+  if (!blocks.rects_.empty() || blocks.cell_map_.moved_) {
+    for_each_live_block(blocks, [&](const int col, const int row) {
+      const cell_rect_t rect = block_drawn_rect(blocks, col, row);
+      for (int y = rect.min_.y_; y <= rect.max_.y_; ++y) {
+        for (int x = rect.min_.x_; x <= rect.max_.x_; ++x) {
+          display.output(offset.x_ + x, offset.y_ + y, glyph);
+        }
       }
-    }
+    });
+    return;
   }
+  for_each_live_block(blocks, [&](const int col, const int row) {
+    for (int block_part = 0; block_part < blocks.block_width; ++block_part) {
+      display.output(
+        offset.x_ + blocks.col_margin + block_part
+          + ((blocks.block_width + blocks.col_spacing) * col),
+        offset.y_ + blocks.row_margin
+          + ((blocks.block_height + blocks.row_spacing) * row),
+        glyph);
+    }
+  });
+}
+
+// compact state of a game at the end of a tick, the blocks destroyed since
+// an earlier frame are the ones between the two blocks_remaining_ values in
+// blocks_t::block_ids_ (which keeps destroyed blocks in order)
+struct rewind_frame_t {
+  int16_t paddle_x_;
+  int16_t second_paddle_x_; // only meaningful in a two player game
+  int16_t ball_x_;
+  int16_t ball_y_;
+  int8_t ball_velocity_x_;
+  int8_t ball_velocity_y_;
+  uint8_t lives_;
+  uint8_t state_;
+  int32_t score_;
+  int32_t blocks_remaining_;
+};
+
+// calls recorded by an input log, each followed by a 16 bit argument for
+// those that take one, enough to replay a session after setup()
+enum class input_op_e : uint8_t {
+  step,
+  move_paddle_left,
+  move_paddle_right,
+  launch_left,
+  launch_right,
+  restart,
+  rewind,
+  move_second_paddle_left,
+  move_second_paddle_right
+};
+
+bool input_op_has_arg(const input_op_e op) {
+  return op == input_op_e::move_paddle_left
+      || op == input_op_e::move_paddle_right || op == input_op_e::rewind
+      || op == input_op_e::move_second_paddle_left
+      || op == input_op_e::move_second_paddle_right;
 }
 
+enum class game_event_e : uint8_t {
+  block_destroyed, // col_ and row_ of the block
+  paddle_hit, // col_ is the player whose paddle it was
+  wall_bounce,
+  life_lost,
+  game_over,
+  game_complete
+};
+
+struct game_event_t {
+  game_event_e type_;
+  int16_t col_;
+  int16_t row_;
+};
+
+// events kept for consumers to catch up on, a power of two
+constexpr int game_event_capacity = 64;
+
+// fixed size ring of the latest events, each consumer keeps a cursor (the
+// number of events it has seen) so any number can read without draining it
+// for the others
+class game_event_ring_t {
+public:
+  void push(const game_event_e type, const int col = 0, const int row = 0) {
+    events_[written_ % game_event_capacity] =
+      game_event_t{type, int16_t(col), int16_t(row)};
+    ++written_;
+  }
+
+  // events pushed so far, a cursor starting here sees only new events
+  [[nodiscard]] uint64_t written() const { return written_; }
+
+  // drops the events pushed after the first written, as a rewind takes back
+  // the ticks they happened in
+  void take_back(const uint64_t written) {
+    written_ = std::min(written_, written);
+  }
+
+  // calls fn for every event after cursor and moves it past them (pulling a
+  // cursor past events taken back since to where they were), returns how
+  // many events were missed by falling more than the capacity behind
+  template<typename fn_t>
+  uint64_t drain(uint64_t& cursor, fn_t&& fn) const {
+    cursor = std::min(cursor, written_);
+    uint64_t missed = 0;
+    if (written_ - cursor > uint64_t(game_event_capacity)) {
+      missed = written_ - cursor - game_event_capacity;
+      cursor += missed;
+    }
+    for (; cursor < written_; ++cursor) {
+      fn(events_[cursor % game_event_capacity]);
+    }
+    return missed;
+  }
+
+private:
+  std::array<game_event_t, game_event_capacity> events_ = {};
+  uint64_t written_ = 0;
+};
+
+// longest run of ticks a trajectory segment covers
+constexpr int trajectory_segment_max_ticks = 4096;
+// end block of a run that stops only as it crosses into or out of the area
+// blocks can be in, so runs outside hold whatever blocks are alive
+constexpr int trajectory_run_continues = -2;
+
+// a run of ticks in which the ball only moves (no bounce, block hit or lost
+// life) with the paddles left out, as cached for where the run starts
+struct trajectory_segment_t {
+  uint64_t key_;
+  uint32_t layout_version_;
+  uint32_t board_version_; // 0 if cached with every block alive
+  uint32_t block_epoch_; // of end_block_ when cached
+  // block hit on the tick after the run (-1 for none), see also
+  // trajectory_run_continues
+  int32_t end_block_;
+  int32_t ticks_;
+};
+
+struct trajectory_cache_stats_t {
+  uint64_t lookups_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t invalidated_ = 0; // found but ended by a block since destroyed
+
+  [[nodiscard]] double hit_rate() const {
+    return lookups_ == 0 ? 0.0 : double(hits_) / double(lookups_);
+  }
+};
+
+// direct mapped cache of trajectory segments keyed by ball position and
+// velocity, a run stays valid until its end block is destroyed or the board
+// is restored
+class trajectory_cache_t {
+public:
+  // slots is rounded up to a power of two, 0 disables the cache
+  void resize(const int slots) {
+    int size = slots > 0 ? 1 : 0;
+    while (size < slots) {
+      size *= 2;
+    }
+    segments_.assign(
+      size, trajectory_segment_t{~uint64_t(0), 0, 0, 0, -1, 0});
+    // index by the top bits of the product (the best mixed), a single slot
+    // still shifts by less than 64 and is masked down to slot 0
+    mask_ = size_t(std::max(size - 1, 0));
+    shift_ = 63;
+    for (int bits = size; bits > 2; bits /= 2) {
+      --shift_;
+    }
+    ++layout_version_;
+  }
+
+  [[nodiscard]] bool enabled() const { return !segments_.empty(); }
+  [[nodiscard]] const trajectory_cache_stats_t& stats() const {
+    return stats_;
+  }
+
+  // a new layout of block_count blocks, nothing cached carries over
+  void reset_blocks(const int block_count) {
+    block_epochs_.assign(block_count, 0);
+    ++layout_version_;
+  }
+  void invalidate_block(const int id) { ++block_epochs_[id]; }
+  void restore_blocks() { ++board_version_; }
+
+  static uint64_t key(const ball_t& ball) {
+    return uint64_t(uint32_t(ball.position_.x_))
+         | (uint64_t(uint16_t(ball.position_.y_)) << 32)
+         | (uint64_t(uint8_t(ball.velocity_.x_)) << 48)
+         | (uint64_t(uint8_t(ball.velocity_.y_)) << 56);
+  }
+
+  [[nodiscard]] const trajectory_segment_t* find(const uint64_t key) {
+    ++stats_.lookups_;
+    const trajectory_segment_t& segment = segments_[slot(key)];
+    if (
+      segment.key_ != key || segment.layout_version_ != layout_version_
+      || (segment.board_version_ != 0
+          && segment.board_version_ != board_version_)) {
+      return nullptr;
+    }
+    if (
+      segment.end_block_ >= 0
+      && block_epochs_[segment.end_block_] != segment.block_epoch_) {
+      ++stats_.invalidated_;
+      return nullptr;
+    }
+    ++stats_.hits_;
+    return &segment;
+  }
+
+  void insert(
+    const uint64_t key, const int end_block, const int ticks,
+    const bool full_board) {
+    segments_[slot(key)] = trajectory_segment_t{
+      key,
+      layout_version_,
+      full_board ? 0 : board_version_,
+      end_block >= 0 ? block_epochs_[end_block] : 0,
+      end_block,
+      ticks};
+  }
+
+private:
+  std::vector<trajectory_segment_t> segments_;
+  std::vector<uint32_t> block_epochs_;
+  uint32_t layout_version_ = 0;
+  uint32_t board_version_ = 1;
+  int shift_ = 63;
+  size_t mask_ = 0; // slots - 1
+  trajectory_cache_stats_t stats_;
+
+  [[nodiscard]] size_t slot(const uint64_t key) const {
+    return size_t((key * 0x9e3779b97f4a7c15ull) >> shift_) & mask_;
+  }
+};
+
 class breakout_t;
 blocks_t create_blocks(const breakout_t& breakout);
+void layout_blocks(const breakout_t& breakout, blocks_t& blocks);
 
 class breakout_t {
 public:
@@ -158,39 +1209,193 @@ public:
     game_complete
   };
 
+  // why step_n() returned
+  enum class step_stop_e { count, state_changed, block_destroyed };
+  struct step_n_result_t {
+    int ticks_;
+    step_stop_e reason_;
+  };
+
   void setup(int x, int y, int width, int height) {
     board_size_ = {width, height};
     board_offset_ = {x, y};
     block_bounce_fn_ = ::block_bounce;
-    create_blocks_fn_ = ::create_blocks;
+    custom_block_bounce_ = false;
+    layout_blocks_fn_ = ::layout_blocks;
+    blocks_ = blocks_t{}; // a new board, nothing cached carries over
     restart();
   }
 
   void restart() {
+    log_input(input_op_e::restart);
     paddle_.position_ = {board_size_.x_ / 2, board_size_.y_ - 1};
     paddle_.width_ = 10; // default size
+    if (players_ == 2) {
+      // split the bottom of the board between the two paddles
+      paddle_.position_.x_ = board_size_.x_ / 3;
+      second_paddle_ = paddle_;
+      second_paddle_.position_.x_ = board_size_.x_ - board_size_.x_ / 3;
+    }
     ball_.position_ = {paddle_.position_.x_, paddle_.position_.y_ - 1};
     ball_.velocity_ = {0, 0};
     state_ = game_state_e::preparing;
     lives_ = starting_lives();
     score_ = 0;
-    blocks_ = create_blocks_fn_(*this);
+    tick_ = 0;
+    // the new blocks are laid out in the storage of the game before last,
+    // usually with the same layout so only their state is reset, and the
+    // two swap places (steady state restarts allocate nothing), a cell map
+    // built for other settings is not reused
+    const vec2 cell_map_size = {board_size_.x_ + 1, board_size_.y_ + 1};
+    if (
+      spare_blocks_.cell_map_.width_ != cell_map_width_
+      || !(spare_blocks_.cell_map_.size_ == cell_map_size)) {
+      build_cell_map(spare_blocks_, {0, 0}, cell_map_width_e::none);
+    }
+    layout_blocks_fn_(*this, spare_blocks_);
+    if (!same_block_layout(spare_blocks_, blocks_)) {
+      ++layout_version_;
+      block_bounds_ = block_layout_bounds(spare_blocks_);
+      if (trajectory_cache_.enabled()) {
+        trajectory_cache_.reset_blocks(int(spare_blocks_.block_ids_.size()));
+      }
+    } else if (trajectory_cache_.enabled()) {
+      trajectory_cache_.restore_blocks();
+    }
+    std::swap(blocks_, spare_blocks_);
+    ++blocks_version_;
+    if (
+      cell_map_width_ != cell_map_width_e::none
+      && blocks_.cell_map_.width_ == cell_map_width_e::none) {
+      build_cell_map(blocks_, cell_map_size, cell_map_width_);
+    }
+    rewind_count_ = 0;
+    record_rewind_frame();
+  }
+
+  // play with one paddle or two (a second player shares the bottom of the
+  // board), takes effect on the next restart()
+  void set_players(const int players) { players_ = std::clamp(players, 1, 2); }
+
+  // the seed every random choice in the game is drawn from (see rng()), the
+  // blocks are created from it on the next restart()
+  void set_seed(const uint64_t seed) { seed_ = seed; }
+
+  // keep the state of the last ticks ticks so the game can be rewound
+  void enable_rewind(const int ticks) {
+    rewind_frames_.assign(ticks + 1, rewind_frame_t{});
+    rewind_events_.assign(ticks + 1, 0);
+    rewind_count_ = 0;
+    record_rewind_frame();
+  }
+
+  // cache the runs of ticks the ball flies freely (see step_free_flight) in
+  // a table of slots entries, 0 turns the cache off
+  void enable_trajectory_cache(const int slots) {
+    trajectory_cache_.resize(slots);
+    trajectory_cache_.reset_blocks(int(blocks_.block_ids_.size()));
+  }
+
+  // record every call that changes the game to log (attach after setup())
+  void set_input_log(std::vector<uint8_t>* input_log) {
+    input_log_ = input_log;
+  }
+
+  // the compact state of the game, as kept for rewinding
+  [[nodiscard]] rewind_frame_t frame() const {
+    return rewind_frame_t{
+      static_cast<int16_t>(paddle_.position_.x_),
+      static_cast<int16_t>(second_paddle_.position_.x_),
+      static_cast<int16_t>(ball_.position_.x_),
+      static_cast<int16_t>(ball_.position_.y_),
+      static_cast<int8_t>(ball_.velocity_.x_),
+      static_cast<int8_t>(ball_.velocity_.y_),
+      static_cast<uint8_t>(lives_),
+      static_cast<uint8_t>(state_),
+      score_,
+      ::blocks_remaining(blocks_)};
+  }
+
+  // ticks the game can currently be rewound by
+  [[nodiscard]] int rewind_available() const {
+    return std::max(rewind_count_ - 1, 0);
+  }
+
+  // return to the state at the end of an earlier tick, only the blocks
+  // destroyed in between are touched, returns how many ticks were rewound
+  int rewind(int ticks) {
+    log_input(input_op_e::rewind, ticks);
+    ticks = std::min(ticks, rewind_available());
+    if (ticks <= 0) {
+      return 0;
+    }
+    const int capacity = int(rewind_frames_.size());
+    rewind_newest_ = (rewind_newest_ - ticks + capacity) % capacity;
+    rewind_count_ -= ticks;
+    tick_ -= ticks;
+    const rewind_frame_t& earlier = rewind_frames_[rewind_newest_];
+    paddle_.position_.x_ = earlier.paddle_x_;
+    second_paddle_.position_.x_ = earlier.second_paddle_x_;
+    ball_.position_ = vec2{earlier.ball_x_, earlier.ball_y_};
+    ball_.velocity_ = vec2{earlier.ball_velocity_x_, earlier.ball_velocity_y_};
+    lives_ = earlier.lives_;
+    score_ = earlier.score_;
+    state_ = static_cast<game_state_e>(earlier.state_);
+    if (earlier.blocks_remaining_ > blocks_.remaining_) {
+      trajectory_cache_.restore_blocks();
+      ++blocks_version_;
+    }
+    restore_blocks(blocks_, earlier.blocks_remaining_);
+    events_.take_back(rewind_events_[rewind_newest_]);
+    return ticks;
   }
 
   using block_bounce_fn_t = std::function<bool(blocks_t& blocks, ball_t& ball)>;
   void set_block_bounce_fn(const block_bounce_fn_t& bounce_fn) {
     block_bounce_fn_ = bounce_fn;
+    custom_block_bounce_ = true;
+  }
+
+  // lays the blocks of a new game out into blocks, which hold the blocks of
+  // an earlier game so their storage can be reused
+  using layout_blocks_fn_t =
+    std::function<void(const breakout_t&, blocks_t& blocks)>;
+  void set_layout_blocks_fn(const layout_blocks_fn_t& layout_blocks_fn) {
+    layout_blocks_fn_ = layout_blocks_fn;
   }
 
+  // blocks created afresh for every game
   using create_blocks_fn_t = std::function<blocks_t(const breakout_t&)>;
   void set_create_blocks_fn(const create_blocks_fn_t& create_blocks_fn) {
-    create_blocks_fn_ = create_blocks_fn;
+    layout_blocks_fn_ = [create_blocks_fn](
+                          const breakout_t& breakout, blocks_t& blocks) {
+      blocks = create_blocks_fn(breakout);
+    };
+  }
+
+  // build a cell map for block lookup on restart (unless the blocks created
+  // already come with one, such as an irregular level)
+  void set_cell_map_width(const cell_map_width_e width) {
+    cell_map_width_ = width;
   }
 
   [[nodiscard]] vec2 board_offset() const { return board_offset_; }
   [[nodiscard]] vec2 board_size() const { return board_size_; }
-  [[nodiscard]] vec2 paddle_position() const { return paddle_.position_; }
-  [[nodiscard]] int paddle_width() const { return paddle_.width_; }
+  [[nodiscard]] int players() const { return players_; }
+  [[nodiscard]] uint64_t seed() const { return seed_; }
+  // steps since the last restart()
+  [[nodiscard]] int tick() const { return tick_; }
+  // random numbers for stream, the same for every game with the same seed
+  // whichever thread draws them
+  [[nodiscard]] counter_rng_t rng(const rng_stream_e stream) const {
+    return counter_rng_t(seed_, stream);
+  }
+  [[nodiscard]] vec2 paddle_position(const int player = 0) const {
+    return paddle(player).position_;
+  }
+  [[nodiscard]] int paddle_width(const int player = 0) const {
+    return paddle(player).width_;
+  }
   [[nodiscard]] vec2 ball_position() const { return ball_.position_; }
   [[nodiscard]] vec2 ball_velocity() const { return ball_.velocity_; }
 
@@ -209,60 +1414,127 @@ public:
     return state_ == game_state_e::launched;
   }
 
+  [[nodiscard]] const blocks_t& blocks() const { return blocks_; }
+  // changes whenever blocks are destroyed or come back (on restart() or
+  // rewind()), so anything drawn from them knows when to redraw
+  [[nodiscard]] uint32_t blocks_version() const { return blocks_version_; }
+  // changes whenever restart() lays the blocks out differently
+  [[nodiscard]] uint32_t layout_version() const { return layout_version_; }
+  // what happened in each step(), see game_event_ring_t::drain
+  [[nodiscard]] const game_event_ring_t& events() const { return events_; }
+  [[nodiscard]] const trajectory_cache_stats_t& trajectory_cache_stats() const {
+    return trajectory_cache_.stats();
+  }
+  [[nodiscard]] int blocks_remaining() const {
+    return ::blocks_remaining(blocks_);
+  }
+
   [[nodiscard]] int block_score() const { return 10; }
   [[nodiscard]] int lives() const { return lives_; }
   [[nodiscard]] int score() const { return score_; }
 
-  [[nodiscard]] int paddle_left_edge() const { return paddle_.left_edge(); }
-  [[nodiscard]] int paddle_right_edge() const { return paddle_.right_edge(); }
+  [[nodiscard]] int paddle_left_edge(const int player = 0) const {
+    return paddle(player).left_edge();
+  }
+  [[nodiscard]] int paddle_right_edge(const int player = 0) const {
+    return paddle(player).right_edge();
+  }
 
-  void launch_left() { launch({-1, -1}); }
-  void launch_right() { launch({1, -1}); }
+  void launch_left() {
+    log_input(input_op_e::launch_left);
+    launch({-1, -1});
+  }
+  void launch_right() {
+    log_input(input_op_e::launch_right);
+    launch({1, -1});
+  }
+  // launch left or right as drawn for the current tick, recorded as the
+  // direction taken so input logs replay without the seed
+  void launch_random() {
+    if (rng(rng_stream_e::launch).below(2, uint64_t(tick_)) == 0) {
+      launch_left();
+    } else {
+      launch_right();
+    }
+  }
 
-  void move_paddle_left(const int distance) {
-    if (paddle_left_edge() > 1) {
-      const int move = std::min(paddle_left_edge() - 1, distance);
-      paddle_.position_.x_ -= move;
+  // the ball rests on the first player's paddle before each launch
+  void move_paddle_left(const int distance, const int player = 0) {
+    log_input(
+      player == 0 ? input_op_e::move_paddle_left
+                  : input_op_e::move_second_paddle_left,
+      distance);
+    if (paddle_left_edge(player) > 1) {
+      const int move = std::min(paddle_left_edge(player) - 1, distance);
+      paddle(player).position_.x_ -= move;
     }
     try_move_ball();
   }
 
-  void move_paddle_right(const int distance) {
-    if (paddle_right_edge() < board_size_.x_) {
+  void move_paddle_right(const int distance, const int player = 0) {
+    log_input(
+      player == 0 ? input_op_e::move_paddle_right
+                  : input_op_e::move_second_paddle_right,
+      distance);
+    if (paddle_right_edge(player) < board_size_.x_) {
       const int move =
-        std::min(board_size_.x_ - paddle_right_edge() - 1, distance);
-      paddle_.position_.x_ += move;
+        std::min(board_size_.x_ - paddle_right_edge(player) - 1, distance);
+      paddle(player).position_.x_ += move;
     }
     try_move_ball();
   }
 
   void step() {
+    log_input(input_op_e::step);
+    ++tick_;
     switch (state_) {
       case game_state_e::preparing:
       case game_state_e::game_over:
       case game_state_e::game_complete:
         break;
       case game_state_e::launched: {
-        ::step(paddle_, ball_);
+        const paddle_t paddles[] = {paddle_, second_paddle_};
+        if (const int player = ::step(paddles, players_, ball_); player >= 0) {
+          events_.push(game_event_e::paddle_hit, player);
+        }
+        const int remaining = ::blocks_remaining(blocks_);
         if (block_bounce_fn_(blocks_, ball_)) {
           score_ += block_score();
         }
-        if (std::all_of(
-              std::begin(blocks_.destroyed_), std::end(blocks_.destroyed_),
-              [](bool d) { return d; })) {
+        if (blocks_.remaining_ != remaining) {
+          ++blocks_version_;
+        }
+        // blocks destroyed by the bounce sit just past the live ones
+        for (int i = remaining - 1; i >= blocks_.remaining_; --i) {
+          const int id = blocks_.block_ids_[i];
+          if (trajectory_cache_.enabled()) {
+            trajectory_cache_.invalidate_block(id);
+          }
+          events_.push(
+            game_event_e::block_destroyed, id % blocks_.col_count,
+            id / blocks_.col_count);
+        }
+        if (::blocks_remaining(blocks_) == 0) {
           state_ = game_state_e::game_complete;
+          events_.push(game_event_e::game_complete);
         }
         if (
           ball_.position_.x_ >= board_size_.x_ - 1 || ball_.position_.x_ <= 1) {
           ball_.velocity_.x_ *= -1;
+          events_.push(game_event_e::wall_bounce);
         }
         if (ball_.position_.y_ <= 0) {
           ball_.velocity_.y_ *= -1;
+          events_.push(game_event_e::wall_bounce);
         }
         if (ball_.position_.y_ >= board_size_.y_) {
           lives_--;
           state_ =
             lives_ == 0 ? game_state_e::game_over : game_state_e::lost_life;
+          events_.push(game_event_e::life_lost);
+          if (lives_ == 0) {
+            events_.push(game_event_e::game_over);
+          }
         }
       } break;
       case game_state_e::lost_life: {
@@ -271,13 +1543,105 @@ public:
         state_ = game_state_e::preparing;
       } break;
     }
+    record_rewind_frame();
   }
 
+  // steps count times just as calling step() count times would, returning
+  // early after a tick that changes the state or destroys a block, step()
+  // with its switch on the state still plays every tick something can
+  // happen on, waiting states only pass their ticks and the ticks the ball
+  // flies freely are jumped (see step_free_flight)
+  step_n_result_t step_n(const int count) {
+    const game_state_e state = state_;
+    if (state != game_state_e::launched && state != game_state_e::lost_life) {
+      // nothing moves until something outside the game does
+      for (int tick = 0; tick < count; ++tick) {
+        log_input(input_op_e::step);
+        record_rewind_frame();
+      }
+      tick_ += std::max(count, 0);
+      return {std::max(count, 0), step_stop_e::count};
+    }
+    int ticks = 0;
+    while (ticks < count) {
+      ticks += step_free_flight(count - ticks);
+      if (ticks == count) {
+        break;
+      }
+      const int remaining = blocks_.remaining_;
+      step();
+      ++ticks;
+      if (state_ != state) {
+        return {ticks, step_stop_e::state_changed};
+      }
+      if (blocks_.remaining_ != remaining) {
+        return {ticks, step_stop_e::block_destroyed};
+      }
+    }
+    return {ticks, step_stop_e::count};
+  }
+
+  // plays up to max_ticks ticks in which the ball does nothing but move,
+  // exactly as step() would, jumping each run with a single lookup once it
+  // is in the trajectory cache (runs are cached without the paddles, which
+  // can only end one on the tick the ball drops into their row), returns
+  // the ticks played (0 if the next tick is not a free one)
+  int step_free_flight(const int max_ticks) {
+    if (
+      state_ != game_state_e::launched || custom_block_bounce_
+      || blocks_.remaining_ == 0) {
+      return 0;
+    }
+    int played = 0;
+    while (played < max_ticks) {
+      int run = 0;
+      int end_block = -1;
+      bool any_board = false; // holds for any board of the layout
+      if (trajectory_cache_.enabled()) {
+        const uint64_t key = trajectory_cache_t::key(ball_);
+        if (const auto* segment = trajectory_cache_.find(key)) {
+          run = segment->ticks_;
+          end_block = segment->end_block_;
+          any_board = segment->board_version_ == 0;
+        } else {
+          run = measure_free_flight(trajectory_segment_max_ticks, end_block);
+          const vec2 next = {
+            ball_.position_.x_ + ball_.velocity_.x_,
+            ball_.position_.y_ + ball_.velocity_.y_};
+          any_board = blocks_.remaining_ == int(blocks_.block_ids_.size())
+                   || !contains(block_bounds_, next);
+          trajectory_cache_.insert(key, end_block, run, any_board);
+        }
+      } else {
+        run = measure_free_flight(max_ticks - played, end_block);
+      }
+
+      const int ticks = std::min(free_of_paddles(run), max_ticks - played);
+      fly(ticks);
+      played += ticks;
+      if (ticks < run) {
+        if (trajectory_cache_.enabled()) {
+          // the rest of the run is cached from where it was left off
+          trajectory_cache_.insert(
+            trajectory_cache_t::key(ball_), end_block, run - ticks,
+            any_board);
+        }
+        break;
+      }
+      if (ticks == 0 || end_block != trajectory_run_continues) {
+        break;
+      }
+    }
+    return played;
+  }
+
+  // the display_ functions draw to a display_t with string glyphs, or to
+  // anything with an output(x, y, glyph) taking its own kind of glyph
+  template<typename output_t, typename glyph_t>
   void display_board(
-    display_t& display, std::string_view horizontal_glyph,
-    std::string_view vertical_glyph, std::string_view top_left_glyph,
-    std::string_view top_right_glyph, std::string_view bottom_left_glyph,
-    std::string_view bottom_right_glyph) {
+    output_t& display, glyph_t horizontal_glyph, glyph_t vertical_glyph,
+    glyph_t top_left_glyph, glyph_t top_right_glyph, glyph_t bottom_left_glyph,
+    glyph_t bottom_right_glyph) const {
     const auto [board_width, board_height] = board_size_;
     const auto [board_x, board_y] = board_offset_;
     display.output(board_x, board_y, top_left_glyph);
@@ -295,23 +1659,28 @@ public:
     }
   }
 
-  void display_paddle(display_t& display, std::string_view glyph) {
+  template<typename output_t, typename glyph_t>
+  void display_paddle(output_t& display, glyph_t glyph) const {
     const auto [board_x, board_y] = board_offset_;
-    const auto [paddle_x, paddle_y] = paddle_position();
-    const auto width = paddle_width();
+    for (int player = 0; player < players_; ++player) {
+      const auto [paddle_x, paddle_y] = paddle_position(player);
+      const auto width = paddle_width(player);
 
-    for (int i = 0; i < width; ++i) {
-      display.output(
-        board_x + paddle_left_edge() + i, board_y + paddle_y, glyph);
+      for (int i = 0; i < width; ++i) {
+        display.output(
+          board_x + paddle_left_edge(player) + i, board_y + paddle_y, glyph);
+      }
     }
   }
 
-  void display_blocks(display_t& display, std::string_view glyph) {
+  template<typename output_t, typename glyph_t>
+  void display_blocks(output_t& display, glyph_t glyph) const {
     const auto [board_x, board_y] = board_offset();
     ::display_blocks(blocks_, vec2{board_x, board_y}, display, glyph);
   }
 
-  void display_ball(display_t& display, std::string_view glyph) {
+  template<typename output_t, typename glyph_t>
+  void display_ball(output_t& display, glyph_t glyph) const {
     const auto [x, y] = ball_.position_;
     const auto [board_x, board_y] = board_offset();
     display.output(board_x + x, board_y + y, glyph);
@@ -321,13 +1690,133 @@ private:
   vec2 board_size_;
   vec2 board_offset_;
   paddle_t paddle_;
+  paddle_t second_paddle_ = {};
+  int players_ = 1;
+  uint64_t seed_ = 0;
+  int tick_ = 0;
   ball_t ball_;
   int lives_;
   int score_;
   game_state_e state_;
   block_bounce_fn_t block_bounce_fn_;
-  create_blocks_fn_t create_blocks_fn_;
+  layout_blocks_fn_t layout_blocks_fn_;
   blocks_t blocks_;
+  blocks_t spare_blocks_ = {}; // an earlier game's, reused by restart()
+  uint32_t blocks_version_ = 0;
+  uint32_t layout_version_ = 0;
+  cell_map_width_e cell_map_width_ = cell_map_width_e::none;
+  game_event_ring_t events_;
+  bool custom_block_bounce_ = false;
+  trajectory_cache_t trajectory_cache_;
+  cell_rect_t block_bounds_ = {}; // see block_layout_bounds
+
+  std::vector<rewind_frame_t> rewind_frames_; // ring buffer, empty if disabled
+  std::vector<uint64_t> rewind_events_; // events written by each frame
+  int rewind_newest_ = 0;
+  int rewind_count_ = 0;
+
+  void record_rewind_frame() {
+    if (rewind_frames_.empty()) {
+      return;
+    }
+    const int capacity = int(rewind_frames_.size());
+    rewind_newest_ = (rewind_newest_ + 1) % capacity;
+    rewind_count_ = std::min(rewind_count_ + 1, capacity);
+    rewind_frames_[rewind_newest_] = frame();
+    rewind_events_[rewind_newest_] = events_.written();
+  }
+
+  std::vector<uint8_t>* input_log_ = nullptr;
+
+  void log_input(const input_op_e op, const int arg = 0) {
+    if (input_log_ == nullptr) {
+      return;
+    }
+    input_log_->push_back(static_cast<uint8_t>(op));
+    if (input_op_has_arg(op)) {
+      const int clamped = std::clamp(arg, 0, 0xffff);
+      input_log_->push_back(static_cast<uint8_t>(clamped & 0xff));
+      input_log_->push_back(static_cast<uint8_t>(clamped >> 8));
+    }
+  }
+
+  [[nodiscard]] paddle_t& paddle(const int player) {
+    return player == 0 ? paddle_ : second_paddle_;
+  }
+  [[nodiscard]] const paddle_t& paddle(const int player) const {
+    return player == 0 ? paddle_ : second_paddle_;
+  }
+
+  // ticks from now (up to limit) in which step() would only move the ball
+  // if there were no paddles, end_block is set to the block hit on the tick
+  // after them (or -1), blocks are only looked up inside their bounds and
+  // runs stop where the ball crosses the edge of those while trajectories
+  // are cached
+  int measure_free_flight(const int limit, int& end_block) const {
+    const bool split = trajectory_cache_.enabled();
+    ball_t ball = ball_;
+    end_block = -1;
+    int ticks = 0;
+    for (bool was_inside = false; ticks < limit; ++ticks) {
+      ball_t next = ball;
+      ::step(nullptr, 0, next);
+      const bool inside = contains(block_bounds_, next.position_);
+      if (inside) {
+        if (const auto hit = intersects(blocks_, next)) {
+          end_block = block_id(blocks_, hit->col_, hit->row_);
+          break;
+        }
+      }
+      const auto [x, y] = next.position_;
+      if (x >= board_size_.x_ - 1 || x <= 1 || y <= 0 || y >= board_size_.y_) {
+        break;
+      }
+      if (split && ticks > 0 && inside != was_inside) {
+        end_block = trajectory_run_continues;
+        break;
+      }
+      was_inside = inside;
+      ball = next;
+    }
+    return ticks;
+  }
+
+  // moves the ball on ticks free ticks
+  void fly(const int ticks) {
+    if (input_log_ != nullptr || !rewind_frames_.empty()) {
+      for (int tick = 0; tick < ticks; ++tick) {
+        log_input(input_op_e::step);
+        ball_.position_.x_ += ball_.velocity_.x_;
+        ball_.position_.y_ += ball_.velocity_.y_;
+        record_rewind_frame();
+      }
+    } else {
+      ball_.position_.x_ += ball_.velocity_.x_ * ticks;
+      ball_.position_.y_ += ball_.velocity_.y_ * ticks;
+    }
+    tick_ += ticks;
+  }
+
+  // the first run ticks of a paddle free run the ball can fly before it
+  // drops onto a paddle
+  [[nodiscard]] int free_of_paddles(const int run) const {
+    const int velocity_y = ball_.velocity_.y_;
+    const int drop = paddle_.position_.y_ - ball_.position_.y_;
+    if (velocity_y <= 0 || drop <= 0 || drop % velocity_y != 0) {
+      return run;
+    }
+    const int ticks = drop / velocity_y;
+    if (ticks > run) {
+      return run;
+    }
+    const int x = ball_.position_.x_ + ball_.velocity_.x_ * ticks;
+    for (int player = 0; player < players_; ++player) {
+      if (x >= paddle_left_edge(player) && x <= paddle_right_edge(player)) {
+        return ticks - 1;
+      }
+    }
+    return run;
+  }
 
   void try_move_ball() {
     if (state_ != game_state_e::launched) {
@@ -343,17 +1832,173 @@ private:
   }
 };
 
+// the dimensions of the standard grid
+blocks_t grid_dimensions(const breakout_t& breakout) {
+  blocks_t dimensions{};
+  dimensions.col_margin = breakout.col_margin();
+  dimensions.row_margin = breakout.row_margin();
+  dimensions.col_spacing = breakout.col_spacing();
+  dimensions.row_spacing = breakout.row_spacing();
+  dimensions.col_count = breakout.block_cols();
+  dimensions.row_count = breakout.block_rows();
+  dimensions.block_height = breakout.block_height();
+  dimensions.block_width = breakout.block_width();
+  return dimensions;
+}
+
+// lays the standard grid out into blocks reusing their storage, blocks
+// already on the grid only have every block brought back
+void layout_blocks(const breakout_t& breakout, blocks_t& blocks) {
+  const blocks_t dimensions = grid_dimensions(breakout);
+  if (same_block_layout(dimensions, blocks)) {
+    reset_blocks(blocks);
+    return;
+  }
+  set_block_dimensions(blocks, dimensions);
+  blocks.rects_.clear();
+  relayout_blocks(blocks);
+}
+
 blocks_t create_blocks(const breakout_t& breakout) {
-  blocks_t blocks;
-  blocks.col_margin = breakout.col_margin();
-  blocks.row_margin = breakout.row_margin();
-  blocks.col_spacing = breakout.col_spacing();
-  blocks.row_spacing = breakout.row_spacing();
-  blocks.col_count = breakout.block_cols();
-  blocks.row_count = breakout.block_rows();
-  blocks.block_height = breakout.block_height();
-  blocks.block_width = breakout.block_width();
-  blocks.destroyed_ =
-    std::deque<bool>(breakout.block_cols() * breakout.block_rows(), false);
+  blocks_t blocks{};
+  layout_blocks(breakout, blocks);
+  return blocks;
+}
+
+// the standard layout with each block kept with a chance of fill_per_mille
+// in 1000, drawn from the game's seed (at least one block is always kept),
+// as a free-form level so the missing blocks are simply never created (each
+// a rect of the cells it is drawn in on the grid), laid out into blocks
+// reusing their storage
+void layout_random_blocks(
+  const breakout_t& breakout, const int fill_per_mille, blocks_t& blocks) {
+  const blocks_t grid = grid_dimensions(breakout);
+  const counter_rng_t rng = breakout.rng(rng_stream_e::blocks);
+  std::vector<cell_rect_t>& rects = blocks.rects_;
+  rects.clear();
+  for (int row = 0; row < grid.row_count; ++row) {
+    for (int col = 0; col < grid.col_count; ++col) {
+      const int id = block_id(grid, col, row);
+      if (rng.below(1000, uint64_t(id)) < fill_per_mille) {
+        rects.push_back(block_drawn_rect(grid, col, row));
+      }
+    }
+  }
+  if (rects.empty()) {
+    const int id = rng.below(grid.col_count * grid.row_count, 0, 1);
+    rects.push_back(
+      block_drawn_rect(grid, id % grid.col_count, id / grid.col_count));
+  }
+  set_block_dimensions(blocks, free_form_dimensions(int(rects.size())));
+  relayout_blocks(blocks);
+}
+
+blocks_t create_random_blocks(
+  const breakout_t& breakout, const int fill_per_mille) {
+  blocks_t blocks{};
+  layout_random_blocks(breakout, fill_per_mille, blocks);
   return blocks;
 }
+
+// where a point moving steps cells in direction (-1 or 1) ends up when it
+// reflects back and forth between low and high
+int fold_between(
+  const int position, const int direction, const int steps, const int low,
+  const int high) {
+  const int span = high - low;
+  if (span <= 0) {
+    return low;
+  }
+  // unfold the bouncing path onto a line that repeats every 2 * span cells
+  const int period = span * 2;
+  const int unfolded =
+    direction > 0 ? position - low : period - (position - low);
+  const int folded = (unfolded + steps) % period;
+  return low + (folded <= span ? folded : period - folded);
+}
+
+// x the ball will have when it next reaches the paddle row, found in closed
+// form by folding its path across the side walls and ceiling (blocks are
+// ignored, so the prediction holds until the ball next hits one)
+std::optional<int> predict_landing_x(const breakout_t& breakout) {
+  const auto [ball_x, ball_y] = breakout.ball_position();
+  const auto [velocity_x, velocity_y] = breakout.ball_velocity();
+  const int paddle_y = breakout.paddle_position().y_;
+  if (!breakout.launched() || velocity_y == 0) {
+    return {};
+  }
+  int ticks = 0;
+  if (velocity_y > 0) {
+    if (ball_y > paddle_y) {
+      return {};
+    }
+    ticks = paddle_y - ball_y;
+  } else {
+    // up to the ceiling and back down again
+    ticks = ball_y + paddle_y;
+  }
+  // step() turns the ball around once it reaches 1 or board width - 1
+  return fold_between(
+    ball_x, velocity_x, ticks, 1, breakout.board_size().x_ - 1);
+}
+
+// drives the paddle towards where the ball will land, moving at most
+// max_distance a call, and launches the ball whenever it is waiting
+void autopilot(breakout_t& breakout, const int max_distance) {
+  if (breakout.state() == breakout_t::game_state_e::preparing) {
+    breakout.launch_left();
+    return;
+  }
+  const auto landing_x = predict_landing_x(breakout);
+  if (!landing_x) {
+    return;
+  }
+  const int offset = *landing_x - breakout.paddle_position().x_;
+  if (offset < 0) {
+    breakout.move_paddle_left(std::min(-offset, max_distance));
+  } else if (offset > 0) {
+    breakout.move_paddle_right(std::min(offset, max_distance));
+  }
+}
+
+// applies the input recorded at offset in an input log to the game, returning
+// the offset of the next input
+size_t replay_input(
+  breakout_t& breakout, const std::vector<uint8_t>& input_log, size_t offset) {
+  const auto op = static_cast<input_op_e>(input_log[offset++]);
+  int arg = 0;
+  if (input_op_has_arg(op)) {
+    arg = input_log[offset] | (input_log[offset + 1] << 8);
+    offset += 2;
+  }
+  switch (op) {
+    case input_op_e::step:
+      breakout.step();
+      break;
+    case input_op_e::move_paddle_left:
+      breakout.move_paddle_left(arg);
+      break;
+    case input_op_e::move_paddle_right:
+      breakout.move_paddle_right(arg);
+      break;
+    case input_op_e::launch_left:
+      breakout.launch_left();
+      break;
+    case input_op_e::launch_right:
+      breakout.launch_right();
+      break;
+    case input_op_e::restart:
+      breakout.restart();
+      break;
+    case input_op_e::rewind:
+      breakout.rewind(arg);
+      break;
+    case input_op_e::move_second_paddle_left:
+      breakout.move_paddle_left(arg, 1);
+      break;
+    case input_op_e::move_second_paddle_right:
+      breakout.move_paddle_right(arg, 1);
+      break;
+  }
+  return offset;
+}
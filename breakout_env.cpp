@@ -0,0 +1,68 @@
+#include "breakout_env.h"
+
+#include "vector_env.h"
+
+struct breakout_env {
+  vector_env_t env_;
+};
+
+// no exception may cross into C, failures are reported as null or -1
+
+breakout_env* breakout_env_create(
+  const int32_t count, const int32_t width, const int32_t height) {
+  if (count < 0 || width <= 0 || height <= 0) {
+    return nullptr;
+  }
+  try {
+    return new breakout_env{vector_env_t(count, width, height)};
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void breakout_env_destroy(breakout_env* env) {
+  delete env;
+}
+
+int32_t breakout_env_count(const breakout_env* env) {
+  return env == nullptr ? -1 : env->env_.count();
+}
+
+int32_t breakout_env_observation_size() {
+  return vector_env_t::observation_size;
+}
+
+int32_t breakout_env_reset(
+  breakout_env* env, const int32_t* ids, const int32_t id_count,
+  int32_t* out_obs) {
+  if (env == nullptr || id_count < 0 || (ids == nullptr && id_count > 0)) {
+    return -1;
+  }
+  for (int32_t i = 0; i < id_count; ++i) {
+    if (ids[i] < 0 || ids[i] >= env->env_.count()) {
+      return -1;
+    }
+  }
+  try {
+    env->env_.reset(ids, id_count, out_obs);
+  } catch (...) {
+    return -1;
+  }
+  return 0;
+}
+
+int32_t breakout_env_step(
+  breakout_env* env, const int8_t* actions, int32_t* out_obs,
+  float* out_reward, uint8_t* out_done) {
+  if (
+    env == nullptr || actions == nullptr || out_obs == nullptr
+    || out_reward == nullptr || out_done == nullptr) {
+    return -1;
+  }
+  try {
+    env->env_.step(actions, out_obs, out_reward, out_done);
+  } catch (...) {
+    return -1;
+  }
+  return 0;
+}
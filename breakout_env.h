@@ -0,0 +1,54 @@
+/* C interface to a batched set of breakout games (see vector_env.h) */
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#ifdef BREAKOUT_ENV_BUILD
+#define BREAKOUT_ENV_API __declspec(dllexport)
+#else
+#define BREAKOUT_ENV_API __declspec(dllimport)
+#endif
+#else
+#define BREAKOUT_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct breakout_env breakout_env;
+
+/* actions accepted by breakout_env_step */
+enum {
+  BREAKOUT_ACTION_NOOP = 0,
+  BREAKOUT_ACTION_LEFT = 1,
+  BREAKOUT_ACTION_RIGHT = 2,
+  BREAKOUT_ACTION_LAUNCH = 3
+};
+
+/* null if count is negative, the board is empty or the games could not be
+ * allocated */
+BREAKOUT_ENV_API breakout_env* breakout_env_create(
+  int32_t count, int32_t width, int32_t height);
+BREAKOUT_ENV_API void breakout_env_destroy(breakout_env* env);
+
+BREAKOUT_ENV_API int32_t breakout_env_count(const breakout_env* env);
+/* number of int32 values written per game observation */
+BREAKOUT_ENV_API int32_t breakout_env_observation_size(void);
+
+/* restarts the games in ids, out_obs (may be null) receives id_count
+ * observations, returns 0 or -1 (restarting nothing) if an id is out of
+ * range */
+BREAKOUT_ENV_API int32_t breakout_env_reset(
+  breakout_env* env, const int32_t* ids, int32_t id_count, int32_t* out_obs);
+
+/* advances every game by one tick, all buffers hold one entry per game
+ * (out_obs one observation per game), returns 0 or -1 on failure */
+BREAKOUT_ENV_API int32_t breakout_env_step(
+  breakout_env* env, const int8_t* actions, int32_t* out_obs,
+  float* out_reward, uint8_t* out_done);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+// counter based random numbers (Widynski's squares), every value is a pure
+// function of a key and a counter so there is no generator state to carry
+// around or share, any game can draw its numbers on any thread in any order
+uint32_t squares32(const uint64_t counter, const uint64_t key) {
+  uint64_t x = counter * key;
+  const uint64_t y = x;
+  const uint64_t z = y + key;
+  x = x * x + y;
+  x = (x >> 32) | (x << 32);
+  x = x * x + z;
+  x = (x >> 32) | (x << 32);
+  x = x * x + y;
+  x = (x >> 32) | (x << 32);
+  return uint32_t((x * x + z) >> 32);
+}
+
+// what the numbers are drawn for, so each use gets its own sequence and
+// adding draws to one never shifts another
+enum class rng_stream_e : uint32_t { launch, blocks, policy, level };
+
+// the numbers of one stream of one game seed, drawn by tick (or any other
+// position, such as a block id) and an index for several draws at the same
+// position
+class counter_rng_t {
+public:
+  counter_rng_t(const uint64_t seed, const rng_stream_e stream) {
+    // squares wants a key with well mixed bits, so mix the seed and stream
+    // (splitmix64) and make it odd
+    uint64_t key = seed + (uint64_t(stream) + 1) * 0x9e3779b97f4a7c15ull;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+    key_ = (key ^ (key >> 31)) | 1;
+  }
+
+  [[nodiscard]] uint32_t draw(
+    const uint64_t position, const uint32_t index = 0) const {
+    return squares32((position << 32) | index, key_);
+  }
+
+  // a value in [0, bound) (bound > 0), scaled rather than taken modulo
+  [[nodiscard]] int below(
+    const int bound, const uint64_t position, const uint32_t index = 0) const {
+    return int((uint64_t(draw(position, index)) * uint32_t(bound)) >> 32);
+  }
+
+private:
+  uint64_t key_;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// a glyph interned in a glyph_table_t, a byte per cell wherever glyphs are
+// stored or passed around
+using glyph_id_t = uint8_t;
+
+// no glyph at all (a transparent cell)
+constexpr glyph_id_t no_glyph = 0;
+
+// first id handed out to glyphs other than printable ascii
+constexpr int first_interned_glyph = 128;
+
+// the strings behind glyph ids, printable ascii is interned up front with
+// its own character code as the id (so text needs no lookup) and every
+// other glyph (such as the multi byte utf-8 box drawing characters) takes
+// the next free id from first_interned_glyph
+class glyph_table_t {
+public:
+  glyph_table_t() {
+    for (int c = ' '; c <= '~'; ++c) {
+      glyphs_[c] = std::string(1, char(c));
+    }
+  }
+
+  // the id of glyph, interning it if it is new (no_glyph for an empty glyph
+  // or once all ids are taken)
+  glyph_id_t intern(const std::string_view glyph) {
+    if (glyph.size() == 1 && glyph[0] >= ' ' && glyph[0] <= '~') {
+      return glyph_id_t(glyph[0]);
+    }
+    if (glyph.empty()) {
+      return no_glyph;
+    }
+    for (int id = first_interned_glyph; id < next_; ++id) {
+      if (glyphs_[id] == glyph) {
+        return glyph_id_t(id);
+      }
+    }
+    if (next_ == int(glyphs_.size())) {
+      return no_glyph;
+    }
+    glyphs_[next_] = std::string(glyph);
+    return glyph_id_t(next_++);
+  }
+
+  // the string to emit for a glyph (empty for no_glyph)
+  [[nodiscard]] std::string_view resolve(const glyph_id_t glyph) const {
+    return glyphs_[glyph];
+  }
+
+  // glyphs interned beyond printable ascii
+  [[nodiscard]] int interned() const { return next_ - first_interned_glyph; }
+
+private:
+  std::array<std::string, 256> glyphs_;
+  int next_ = first_interned_glyph;
+};
+
+// takes glyph ids, display_t is where they are finally resolved to strings
+struct glyph_display_t {
+  virtual void output(int x, int y, glyph_id_t glyph) = 0;
+
+protected:
+  ~glyph_display_t() = default;
+};
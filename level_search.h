@@ -0,0 +1,209 @@
+#pragma once
+
+#include "batch_runner.h"
+#include "breakout.h"
+#include "counter_rng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a level is a free-form block layout, saved as a text header line followed
+// by a line per block rect
+constexpr std::string_view level_magic = "breakout-level";
+constexpr int level_version = 1;
+
+// bounds on what a level file may hold, every rect lies within a square of
+// level_max_cell cells from the origin (larger ones would take the display
+// an age to draw)
+constexpr int level_max_blocks = 1 << 16;
+constexpr int level_max_cell = 1024;
+
+void save_level(std::ostream& out, const std::vector<cell_rect_t>& rects) {
+  out << level_magic << ' ' << level_version << ' ' << rects.size() << '\n';
+  for (const cell_rect_t& rect : rects) {
+    out << rect.min_.x_ << ' ' << rect.min_.y_ << ' ' << rect.max_.x_ << ' '
+        << rect.max_.y_ << '\n';
+  }
+}
+
+// nothing for a level that is malformed, empty, too large or holds a rect
+// that is inverted or out of bounds
+std::optional<std::vector<cell_rect_t>> load_level(std::istream& in) {
+  std::string magic;
+  int version = 0;
+  size_t count = 0;
+  in >> magic >> version >> count;
+  if (
+    !in || magic != level_magic || version != level_version || count == 0
+    || count > size_t(level_max_blocks)) {
+    return {};
+  }
+  std::vector<cell_rect_t> rects(count);
+  for (cell_rect_t& rect : rects) {
+    in >> rect.min_.x_ >> rect.min_.y_ >> rect.max_.x_ >> rect.max_.y_;
+    if (
+      !in || rect.min_.x_ < 0 || rect.min_.y_ < 0
+      || rect.max_.x_ < rect.min_.x_ || rect.max_.y_ < rect.min_.y_
+      || rect.max_.x_ >= level_max_cell || rect.max_.y_ >= level_max_cell) {
+      return {};
+    }
+  }
+  return rects;
+}
+
+// plays a level, for breakout_t::set_layout_blocks_fn
+breakout_t::layout_blocks_fn_t level_blocks_fn(
+  std::vector<cell_rect_t> rects) {
+  return [rects = std::move(rects)](const breakout_t&, blocks_t& blocks) {
+    layout_free_form_blocks(rects, blocks);
+  };
+}
+
+struct level_search_config_t {
+  uint64_t seed_ = 0;
+  int candidates_ = 256;
+  int games_per_candidate_ = 16;
+  int max_ticks_ = 20000;
+  int keep_ = 8;
+  // share of lives lost (0 to 1) the bot should have on the levels kept
+  double target_difficulty_ = 0.5;
+  int threads_ = int(std::thread::hardware_concurrency());
+  vec2 board_size_ = {101, 30};
+  batch_autopilot_t bot_;
+};
+
+// threads search_levels evaluates the candidates on
+[[nodiscard]] int level_search_thread_count(
+  const level_search_config_t& config) {
+  return std::max(config.threads_, 1);
+}
+
+// a sampled layout and how the bot fared playing it
+struct level_candidate_t {
+  uint64_t seed_ = 0;
+  int fill_per_mille_ = 0;
+  std::vector<cell_rect_t> rects_;
+  int games_ = 0;
+  int cleared_ = 0;
+  int timed_out_ = 0;
+  int lives_lost_ = 0;
+  uint64_t clear_ticks_ = 0; // over the games cleared
+
+  [[nodiscard]] double difficulty(const int starting_lives) const {
+    return double(lives_lost_) / double(std::max(games_ * starting_lives, 1));
+  }
+  [[nodiscard]] double mean_clear_ticks() const {
+    return cleared_ == 0 ? 0.0 : double(clear_ticks_) / double(cleared_);
+  }
+  // how far from the target the level is, games the bot never finishes
+  // (blocks out of reach) count against it
+  [[nodiscard]] double distance(
+    const double target, const int starting_lives) const {
+    return std::abs(difficulty(starting_lives) - target)
+         + double(timed_out_) / double(std::max(games_, 1));
+  }
+};
+
+struct level_search_result_t {
+  std::vector<level_candidate_t> best_; // closest to the target first
+  int evaluated_ = 0;
+  double seconds_ = 0.0;
+
+  [[nodiscard]] double candidates_per_second() const {
+    return seconds_ > 0.0 ? double(evaluated_) / seconds_ : 0.0;
+  }
+};
+
+// the layout of a candidate, each drawn from the search seed so any one can
+// be rebuilt on its own
+level_candidate_t sample_level(
+  breakout_t& breakout, const uint64_t search_seed, const int candidate) {
+  const counter_rng_t rng(search_seed, rng_stream_e::level);
+  level_candidate_t level;
+  level.seed_ = (uint64_t(rng.draw(uint64_t(candidate), 0)) << 32)
+              | rng.draw(uint64_t(candidate), 1);
+  level.fill_per_mille_ = 250 + rng.below(650, uint64_t(candidate), 2);
+  breakout.set_seed(level.seed_);
+  level.rects_ = create_random_blocks(breakout, level.fill_per_mille_).rects_;
+  return level;
+}
+
+// plays the bot on a level games times, game i seeded with i so every level
+// is played with the same luck
+void evaluate_level(
+  breakout_t& breakout, level_candidate_t& level, const int games,
+  const int max_ticks, const batch_autopilot_t& bot) {
+  breakout.set_layout_blocks_fn(level_blocks_fn(level.rects_));
+  batch_result_t result;
+  for (int game = 0; game < games; ++game) {
+    play_batch_game(breakout, uint64_t(game), max_ticks, bot, result);
+  }
+  level.games_ += int(result.games_);
+  level.cleared_ += int(result.completed_);
+  level.timed_out_ += int(result.timed_out_);
+  level.lives_lost_ += int(result.lives_lost_);
+  level.clear_ticks_ += result.completed_ticks_;
+}
+
+// samples and evaluates candidates_ levels across a pool of threads (taking
+// the next candidate from a shared counter) and keeps the keep_ closest to
+// the target difficulty, quicker to clear breaking ties, the levels kept are
+// the same however many threads run (a negative count searches nothing)
+level_search_result_t search_levels(const level_search_config_t& config) {
+  const auto begin = std::chrono::steady_clock::now();
+  const int candidate_count = std::max(config.candidates_, 0);
+  std::vector<level_candidate_t> candidates(candidate_count);
+  std::atomic<int> next = 0;
+  const auto work = [&] {
+    breakout_t breakout;
+    breakout.setup(0, 0, config.board_size_.x_, config.board_size_.y_);
+    for (int candidate = next++; candidate < candidate_count;
+         candidate = next++) {
+      level_candidate_t level =
+        sample_level(breakout, config.seed_, candidate);
+      evaluate_level(
+        breakout, level, config.games_per_candidate_, config.max_ticks_,
+        config.bot_);
+      candidates[candidate] = std::move(level);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < level_search_thread_count(config); ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const int starting_lives = breakout_t{}.starting_lives();
+  const auto closer = [&](const auto& lhs, const auto& rhs) {
+    const double lhs_distance =
+      lhs.distance(config.target_difficulty_, starting_lives);
+    const double rhs_distance =
+      rhs.distance(config.target_difficulty_, starting_lives);
+    if (lhs_distance != rhs_distance) {
+      return lhs_distance < rhs_distance;
+    }
+    return lhs.mean_clear_ticks() < rhs.mean_clear_ticks();
+  };
+  level_search_result_t result;
+  result.evaluated_ = candidate_count;
+  const int keep = std::clamp(config.keep_, 0, candidate_count);
+  std::partial_sort(
+    candidates.begin(), candidates.begin() + keep, candidates.end(), closer);
+  candidates.resize(keep);
+  result.best_ = std::move(candidates);
+  result.seconds_ = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count();
+  return result;
+}
@@ -0,0 +1,56 @@
+#include "level_search.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+// searches for levels the mixed autopilot loses the target share of lives
+// on, writing the best to <out prefix>-<n>.level (play them with --level)
+// usage: tdd-breakout-levels [candidates] [games per candidate]
+//                            [target difficulty] [threads] [out prefix]
+int main(int argc, char** argv) {
+  level_search_config_t config;
+  if (argc > 1) {
+    config.candidates_ = std::stoi(argv[1]);
+  }
+  if (argc > 2) {
+    config.games_per_candidate_ = std::stoi(argv[2]);
+  }
+  if (argc > 3) {
+    config.target_difficulty_ = std::stod(argv[3]);
+  }
+  if (argc > 4) {
+    config.threads_ = std::stoi(argv[4]);
+  }
+  const std::string prefix = argc > 5 ? argv[5] : "breakout";
+  if (config.candidates_ < 0 || config.games_per_candidate_ < 0) {
+    std::fprintf(
+      stderr,
+      "usage: %s [candidates] [games per candidate] [target difficulty] "
+      "[threads] [out prefix]\n",
+      argv[0]);
+    return 1;
+  }
+
+  const level_search_result_t result = search_levels(config);
+  std::printf(
+    "%d candidates (%d games each) on %d threads in %.2fs, "
+    "%.1f candidates/s\n",
+    result.evaluated_, config.games_per_candidate_,
+    level_search_thread_count(config), result.seconds_,
+    result.candidates_per_second());
+
+  const int starting_lives = breakout_t{}.starting_lives();
+  for (size_t i = 0; i < result.best_.size(); ++i) {
+    const level_candidate_t& level = result.best_[i];
+    const std::string path = prefix + "-" + std::to_string(i) + ".level";
+    std::ofstream file(path);
+    save_level(file, level.rects_);
+    std::printf(
+      "%s: %zu blocks, difficulty %.2f, cleared %d/%d, "
+      "mean clear %.0f ticks\n",
+      path.c_str(), level.rects_.size(), level.difficulty(starting_lives),
+      level.cleared_, level.games_, level.mean_clear_ticks());
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include "lockstep.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+
+// one of two processes playing a two player game in lockstep over a unix
+// domain socket, each paddle steered by a simple bot covering its half of
+// the board
+// usage: tdd-breakout-lockstep host|join <socket path> [ticks]
+//        [input delay] [added latency ms]
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+int open_socket(const bool host, const char* path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  const int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (!host) {
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))
+        < 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+  unlink(path);
+  if (
+    bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+    || listen(fd, 1) < 0) {
+    close(fd);
+    return -1;
+  }
+  const int peer = accept(fd, nullptr, nullptr);
+  close(fd);
+  unlink(path);
+  return peer;
+}
+
+uint8_t bot_input(const breakout_t& game, const int player) {
+  if (game.state() == breakout_t::game_state_e::preparing) {
+    return player == 0 ? lockstep_launch : 0;
+  }
+  const int half = game.board_size().x_ / 2;
+  const int target = player == 0
+                     ? std::min(game.ball_position().x_, half)
+                     : std::max(game.ball_position().x_, half);
+  const int paddle_x = game.paddle_position(player).x_;
+  if (paddle_x > target + 1) {
+    return lockstep_left;
+  }
+  if (paddle_x < target - 1) {
+    return lockstep_right;
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::fprintf(
+      stderr,
+      "usage: %s host|join <socket path> [ticks] [input delay] "
+      "[added latency ms]\n",
+      argv[0]);
+    return 1;
+  }
+  const bool host = std::strcmp(argv[1], "host") == 0;
+  const int ticks = argc > 3 ? std::stoi(argv[3]) : 1000;
+  const int input_delay = argc > 4 ? std::stoi(argv[4]) : 2;
+  const auto latency =
+    std::chrono::milliseconds(argc > 5 ? std::stoi(argv[5]) : 0);
+  const auto tick_period = std::chrono::milliseconds(16);
+
+  const int fd = open_socket(host, argv[2]);
+  if (fd < 0) {
+    std::perror("socket");
+    return 1;
+  }
+
+  lockstep_t lockstep(host ? 0 : 1, input_delay, 32, 101, 30);
+
+  // messages wait here until the added latency has passed
+  struct pending_t {
+    clock_type::time_point due_;
+    uint8_t bytes_[lockstep_message_size];
+  };
+  std::deque<pending_t> outgoing;
+
+  bool connected = true;
+  auto next_tick = clock_type::now();
+  while (connected
+         && (lockstep.tick() < ticks || lockstep.confirmed_tick() < ticks
+             || !outgoing.empty())) {
+    const auto now = clock_type::now();
+    while (!outgoing.empty() && outgoing.front().due_ <= now) {
+      send(fd, outgoing.front().bytes_, lockstep_message_size, MSG_NOSIGNAL);
+      outgoing.pop_front();
+    }
+
+    if (now >= next_tick) {
+      next_tick += tick_period;
+      if (lockstep.needs_local_input()) {
+        pending_t pending{now + latency, {}};
+        encode_lockstep_message(
+          lockstep.local_input(
+            bot_input(lockstep.game(), lockstep.local_player())),
+          pending.bytes_);
+        outgoing.push_back(pending);
+      }
+      if (lockstep.tick() < ticks) {
+        lockstep.advance();
+      }
+    }
+
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+      next_tick - clock_type::now());
+    pollfd poll_fd{fd, POLLIN, 0};
+    if (poll(&poll_fd, 1, std::max(int(wait.count()), 0)) > 0) {
+      uint8_t bytes[lockstep_message_size];
+      while (true) {
+        const ssize_t size =
+          recv(fd, bytes, sizeof(bytes), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (size == 0) {
+          connected = false;
+        }
+        if (size != lockstep_message_size) {
+          break;
+        }
+        lockstep.receive(decode_lockstep_message(bytes));
+      }
+    }
+  }
+  const bool in_sync = lockstep.resolve();
+  close(fd);
+  if (!in_sync) {
+    std::fprintf(
+      stderr, "player %d desynced at tick %d\n", lockstep.local_player(),
+      lockstep.tick());
+    return 1;
+  }
+
+  // both processes print the same game line when they stayed in sync
+  const breakout_t& game = lockstep.game();
+  std::printf(
+    "player %d tick %d confirmed %d: score %d lives %d blocks %d ball %d,%d\n",
+    lockstep.local_player(), lockstep.tick(), lockstep.confirmed_tick(),
+    game.score(), game.lives(), game.blocks_remaining(),
+    game.ball_position().x_, game.ball_position().y_);
+  const lockstep_metrics_t& metrics = lockstep.metrics();
+  std::printf(
+    "rtt %.2fms  rollbacks %lld  resimulated ticks %lld (%lldns per tick)  "
+    "stalls %lld  rejected %lld\n",
+    double(metrics.rtt_ns_) / 1e6, static_cast<long long>(metrics.rollbacks_),
+    static_cast<long long>(metrics.resimulated_ticks_),
+    static_cast<long long>(metrics.resimulation_ns_per_tick()),
+    static_cast<long long>(metrics.stalls_),
+    static_cast<long long>(metrics.rejected_));
+  return 0;
+}
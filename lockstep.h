@@ -0,0 +1,245 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// what one player did in a tick
+enum lockstep_input_e : uint8_t {
+  lockstep_left = 1,
+  lockstep_right = 2,
+  lockstep_launch = 4
+};
+
+// sent by each peer once per tick, carrying its input for a future tick and
+// how many ticks of the other peer's input it has received
+struct lockstep_message_t {
+  uint32_t tick_;
+  uint32_t ack_;
+  uint8_t input_;
+};
+
+constexpr int lockstep_message_size = 9;
+
+void encode_lockstep_message(const lockstep_message_t& message, uint8_t* out) {
+  for (int i = 0; i < 4; ++i) {
+    out[i] = static_cast<uint8_t>(message.tick_ >> (i * 8));
+    out[4 + i] = static_cast<uint8_t>(message.ack_ >> (i * 8));
+  }
+  out[8] = message.input_;
+}
+
+lockstep_message_t decode_lockstep_message(const uint8_t* in) {
+  lockstep_message_t message{0, 0, in[8]};
+  for (int i = 0; i < 4; ++i) {
+    message.tick_ |= uint32_t(in[i]) << (i * 8);
+    message.ack_ |= uint32_t(in[4 + i]) << (i * 8);
+  }
+  return message;
+}
+
+struct lockstep_metrics_t {
+  int64_t rtt_ns_ = 0; // smoothed time from sending an input to its ack
+  int64_t rollbacks_ = 0;
+  int64_t resimulated_ticks_ = 0;
+  int64_t resimulation_ns_ = 0;
+  int64_t stalls_ = 0; // advances refused for running too far ahead
+  int64_t rejected_ = 0; // messages received twice or for ticks out of reach
+
+  [[nodiscard]] int64_t resimulation_ns_per_tick() const {
+    return resimulated_ticks_ == 0 ? 0 : resimulation_ns_ / resimulated_ticks_;
+  }
+};
+
+// one peer of a two player game run in deterministic lockstep, local input
+// is delayed by input_delay ticks and the other player's input is predicted
+// (repeating their last known input) so the game never waits on the network,
+// if a prediction turns out wrong the game is rewound and resimulated
+class lockstep_t {
+public:
+  static constexpr int paddle_speed = 2;
+
+  lockstep_t(
+    const int local_player, const int input_delay, const int max_rollback,
+    const int width, const int height)
+    : local_player_(local_player),
+      input_delay_(input_delay),
+      max_rollback_(max_rollback),
+      next_local_tick_(input_delay),
+      remote_confirmed_(input_delay) {
+    game_.set_players(2);
+    game_.setup(0, 0, width, height);
+    game_.enable_rewind(max_rollback);
+    // neither player acts before the input delay has passed
+    reserve(input_delay);
+    std::fill(received_.begin(), received_.end(), 1);
+  }
+
+  [[nodiscard]] const breakout_t& game() const { return game_; }
+  [[nodiscard]] int local_player() const { return local_player_; }
+  [[nodiscard]] int tick() const { return tick_; }
+  // ticks for which both players' inputs are known
+  [[nodiscard]] int confirmed_tick() const {
+    return std::min(remote_confirmed_, next_local_tick_);
+  }
+  [[nodiscard]] const lockstep_metrics_t& metrics() const { return metrics_; }
+  // true once a rollback reached further back than the rewind history, the
+  // peers can no longer agree and the game is not advanced again
+  [[nodiscard]] bool desynced() const { return desynced_; }
+
+  // true once the local input for the tick input_delay ahead is wanted
+  [[nodiscard]] bool needs_local_input() const {
+    return next_local_tick_ <= tick_ + input_delay_;
+  }
+
+  // schedules the local player's input, returning the message to send
+  lockstep_message_t local_input(const uint8_t input) {
+    const int tick = next_local_tick_++;
+    reserve(tick + 1);
+    inputs_[local_player_][tick] = input;
+    send_times_[tick] = now();
+    return lockstep_message_t{
+      uint32_t(tick), uint32_t(remote_confirmed_), input};
+  }
+
+  // takes an input from the other player, scheduling a rollback if a tick
+  // already simulated guessed it wrong, returns false (ignoring it) for an
+  // input received before or for a tick the other player cannot have reached
+  // (it stalls max_rollback ticks past the last local input it has)
+  bool receive(const lockstep_message_t& message) {
+    if (
+      message.tick_ < uint32_t(remote_confirmed_)
+      || message.tick_
+           > uint32_t(next_local_tick_ + max_rollback_ + input_delay_)
+      || (message.tick_ < received_.size() && received_[message.tick_] != 0)) {
+      metrics_.rejected_++;
+      return false;
+    }
+    const int tick = int(message.tick_);
+    reserve(tick + 1);
+    const int remote_player = 1 - local_player_;
+    if (tick < tick_ && inputs_[remote_player][tick] != message.input_) {
+      rollback_from_ = std::min(rollback_from_, tick);
+    }
+    inputs_[remote_player][tick] = message.input_;
+    received_[tick] = 1;
+    while (remote_confirmed_ < int(received_.size())
+           && received_[remote_confirmed_] != 0) {
+      ++remote_confirmed_;
+    }
+
+    const int acked = int(message.ack_) - 1;
+    if (acked > last_acked_ && acked < next_local_tick_) {
+      last_acked_ = acked;
+      const int64_t rtt = now() - send_times_[acked];
+      metrics_.rtt_ns_ = metrics_.rtt_ns_ == 0
+                         ? rtt
+                         : metrics_.rtt_ns_ + (rtt - metrics_.rtt_ns_) / 8;
+    }
+    return true;
+  }
+
+  // resimulates from the earliest mispredicted tick, if any, returns false
+  // if the tick is older than the rewind history (see desynced)
+  bool resolve() {
+    if (desynced_) {
+      return false;
+    }
+    if (rollback_from_ >= tick_) {
+      rollback_from_ = no_rollback;
+      return true;
+    }
+    const auto begin = now();
+    const int ticks = tick_ - rollback_from_;
+    if (ticks > game_.rewind_available()) {
+      desynced_ = true;
+      return false;
+    }
+    game_.rewind(ticks);
+    tick_ = rollback_from_;
+    rollback_from_ = no_rollback;
+    for (int i = 0; i < ticks; ++i) {
+      simulate();
+    }
+    metrics_.rollbacks_++;
+    metrics_.resimulated_ticks_ += ticks;
+    metrics_.resimulation_ns_ += now() - begin;
+    return true;
+  }
+
+  // simulates the next tick, refusing (returning false) until the local
+  // input is known, if the other player's input has fallen further behind
+  // than can be rolled back or once desynced
+  bool advance() {
+    if (!resolve() || next_local_tick_ <= tick_) {
+      return false;
+    }
+    if (tick_ - remote_confirmed_ >= max_rollback_) {
+      metrics_.stalls_++;
+      return false;
+    }
+    simulate();
+    return true;
+  }
+
+private:
+  static constexpr int no_rollback = INT32_MAX;
+
+  breakout_t game_;
+  int local_player_;
+  int input_delay_;
+  int max_rollback_;
+  int tick_ = 0; // ticks simulated
+  int next_local_tick_;
+  int remote_confirmed_; // every remote input before this has been received
+  int last_acked_ = -1;
+  int rollback_from_ = no_rollback;
+  bool desynced_ = false;
+  std::vector<uint8_t> inputs_[2]; // per player, predicted until received
+  std::vector<uint8_t> received_; // remote input received for each tick
+  std::vector<int64_t> send_times_;
+  lockstep_metrics_t metrics_;
+
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+
+  void reserve(const int ticks) {
+    if (ticks > int(received_.size())) {
+      inputs_[0].resize(ticks, 0);
+      inputs_[1].resize(ticks, 0);
+      received_.resize(ticks, 0);
+      send_times_.resize(ticks, 0);
+    }
+  }
+
+  // applies both players' inputs for the next tick (guessing the remote one
+  // if it has not arrived) and steps the game
+  void simulate() {
+    const int remote_player = 1 - local_player_;
+    if (received_[tick_] == 0) {
+      inputs_[remote_player][tick_] =
+        remote_confirmed_ > 0 ? inputs_[remote_player][remote_confirmed_ - 1]
+                              : 0;
+    }
+    for (int player = 0; player < 2; ++player) {
+      const uint8_t input = inputs_[player][tick_];
+      if ((input & lockstep_left) != 0) {
+        game_.move_paddle_left(paddle_speed, player);
+      }
+      if ((input & lockstep_right) != 0) {
+        game_.move_paddle_right(paddle_speed, player);
+      }
+      if ((input & lockstep_launch) != 0) {
+        game_.launch_left();
+      }
+    }
+    game_.step();
+    ++tick_;
+  }
+};
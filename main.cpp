@@ -1,6 +1,13 @@
 #include "breakout.h"
+#include "level_search.h"
+#include "render_layers.h"
+#include "session.h"
+#include "shared_state.h"
 
+#include <charconv>
 #include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <thread>
 #include <string>
@@ -41,6 +48,35 @@ int main(int argc, char** argv) {
   // enable support for unicode characters
   setlocale(LC_CTYPE, "");
 
+  // --record <file> saves every input so the game can be replayed later
+  // --publish <name> shares the state with observers every tick
+  // --seed <n> picks the launch directions (a new seed each run otherwise)
+  // --level <file> plays a level made by tdd-breakout-levels
+  const char* record_path = nullptr;
+  const char* level_path = nullptr;
+  const char* publish_name = nullptr;
+  auto seed = uint64_t(
+    std::chrono::steady_clock::now().time_since_epoch().count());
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (std::strcmp(argv[i], "--record") == 0) {
+      record_path = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--publish") == 0) {
+      publish_name = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--seed") == 0) {
+      const char* const text = argv[i + 1];
+      const char* const end = text + std::strlen(text);
+      if (const auto [ptr, error] = std::from_chars(text, end, seed);
+          error != std::errc() || ptr != end) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--record <file>] [--publish <name>] [--seed <n>]"
+                     " [--level <file>]\n";
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--level") == 0) {
+      level_path = argv[i + 1];
+    }
+  }
+
   initscr(); // start curses mode
   curs_set(0); // hide cursor
   cbreak(); // line buffering disabled (respects Ctrl-C to quit)
@@ -48,10 +84,44 @@ int main(int argc, char** argv) {
   nodelay(stdscr, TRUE); // do not block
   noecho(); // don't echo while we do getch
 
-  breakout_t breakout;
-  breakout.setup(10, 5, 101, 30);
+  session_t session{vec2{10, 5}, vec2{101, 30}, 100}; // 10 seconds of rewind
+  if (level_path != nullptr) {
+    std::ifstream level_file(level_path);
+    if (auto level = load_level(level_file)) {
+      session.level_ = std::move(*level);
+    }
+  }
+  breakout_t breakout = start_session(session);
+  breakout.set_seed(seed);
+  if (record_path != nullptr) {
+    breakout.set_input_log(&session.inputs_);
+  }
+
+#ifdef BREAKOUT_SHARED_STATE_POSIX
+  shared_state_mapping_t published;
+  if (publish_name != nullptr) {
+    published = shared_state_mapping_t::publish(publish_name);
+  }
+#endif
+  uint32_t tick = 0;
 
   display_console_t display_console;
+  // glyphs are drawn as small ids and only turned back into strings as
+  // they are written to the screen
+  glyph_table_t glyph_table;
+  glyph_resolver_t screen(glyph_table, display_console);
+  // the board is drawn once and only the cells that change each frame are
+  // written to the screen
+  breakout_layers_t layers(breakout_glyphs_t{
+    glyph_table.intern(board_horizontal_glyph),
+    glyph_table.intern(board_vertical_glyph),
+    glyph_table.intern(board_top_left_glyph),
+    glyph_table.intern(board_top_right_glyph),
+    glyph_table.intern(board_bottom_left_glyph),
+    glyph_table.intern(board_bottom_right_glyph),
+    glyph_table.intern(paddle_glyph), glyph_table.intern(block_glyph),
+    glyph_table.intern(ball_glyph)});
+  bool autopilot_enabled = false;
   for (bool running = true; running;) {
     switch (int key = getch(); key) {
       case KEY_LEFT:
@@ -66,9 +136,23 @@ int main(int argc, char** argv) {
             breakout.restart();
             break;
           default:
-            breakout.launch_left();
+            breakout.launch_random();
             break;
         }
+        break;
+      case 'a':
+        autopilot_enabled = !autopilot_enabled;
+        break;
+      case 'r':
+        breakout.rewind(10); // 1 second
+        break;
+      case 'q':
+        running = false;
+        break;
+      case KEY_RESIZE:
+        clear();
+        layers.invalidate();
+        break;
       case ERR:
         // do nothing
         break;
@@ -76,58 +160,61 @@ int main(int argc, char** argv) {
         break;
     }
 
+    if (autopilot_enabled) {
+      // play unattended, starting a new game whenever one ends
+      switch (breakout.state()) {
+        case breakout_t::game_state_e::game_over:
+        case breakout_t::game_state_e::game_complete:
+          breakout.restart();
+          break;
+        default:
+          autopilot(breakout, 2);
+          break;
+      }
+    }
+
     breakout.step();
+    ++tick;
+#ifdef BREAKOUT_SHARED_STATE_POSIX
+    if (published.valid()) {
+      write_shared_state(
+        published.state(), make_shared_state_record(breakout, tick));
+    }
+#endif
 
-    clear();
-    breakout.display_board(
-      display_console, board_horizontal_glyph, board_vertical_glyph,
-      board_top_left_glyph, board_top_right_glyph, board_bottom_left_glyph,
-      board_bottom_right_glyph);
-
-    const auto show_final_score = [&breakout] {
-      const std::string final_score =
-        "Final Score: " + std::to_string(breakout.score());
-      mvprintw(
-        breakout.board_offset().y_ + breakout.board_size().y_ / 2 + 2,
-        breakout.board_offset().x_ + (breakout.board_size().x_ / 2)
-          - (final_score.size() / 2),
-        final_score.c_str());
+    layers.update(breakout);
+    render_layer_t& overlay = layers.dynamic();
+    const int centre_x =
+      breakout.board_offset().x_ + breakout.board_size().x_ / 2;
+    const int centre_y =
+      breakout.board_offset().y_ + breakout.board_size().y_ / 2;
+    const auto show_message = [&](const std::string_view message) {
+      draw_text(overlay, centre_x - int(message.size() / 2), centre_y, message);
+      constexpr std::string_view final_score = "Final Score: ";
+      const int width = int(
+        final_score.size() + std::to_string(breakout.score()).size());
+      draw_text(overlay, centre_x - width / 2, centre_y + 2, final_score);
+      draw_number(
+        overlay, centre_x - width / 2 + int(final_score.size()), centre_y + 2,
+        breakout.score());
     };
 
     switch (breakout.state()) {
-      case breakout_t::game_state_e::game_over: {
-        constexpr std::string_view game_over_msg = "Game Over";
-        mvprintw(
-          breakout.board_offset().y_ + breakout.board_size().y_ / 2,
-          breakout.board_offset().x_ + (breakout.board_size().x_ / 2)
-            - (game_over_msg.size() / 2),
-          "%.*s", int(game_over_msg.length()), game_over_msg.data());
-        show_final_score();
-      } break;
-      case breakout_t::game_state_e::game_complete: {
-        constexpr std::string_view game_over_msg = "You Won!";
-        mvprintw(
-          breakout.board_offset().y_ + breakout.board_size().y_ / 2,
-          breakout.board_offset().x_ + (breakout.board_size().x_ / 2)
-            - (game_over_msg.size() / 2),
-          "%.*s", int(game_over_msg.length()), game_over_msg.data());
-        show_final_score();
-
-      } break;
+      case breakout_t::game_state_e::game_over:
+        show_message("Game Over");
+        break;
+      case breakout_t::game_state_e::game_complete:
+        show_message("You Won!");
+        break;
       default:
-        breakout.display_paddle(display_console, paddle_glyph);
-        breakout.display_blocks(display_console, block_glyph);
-        breakout.display_ball(display_console, ball_glyph);
-        mvprintw(
-          breakout.board_offset().y_ + 1,
-          breakout.board_offset().x_ + breakout.board_size().x_ + 5,
-          "Lives: %d", breakout.lives());
-        mvprintw(
-          breakout.board_offset().y_ + 3,
-          breakout.board_offset().x_ + breakout.board_size().x_ + 5,
-          "Score: %d", breakout.score());
+        if (autopilot_enabled) {
+          draw_text(
+            overlay, breakout_layers_t::label_x(breakout),
+            breakout.board_offset().y_ + 7, "Autopilot");
+        }
         break;
     }
+    layers.layers().composite(screen);
 
     using std::chrono_literals::operator""ms;
     std::this_thread::sleep_for(100ms);
@@ -135,5 +222,10 @@ int main(int argc, char** argv) {
 
   endwin();
 
+  if (record_path != nullptr) {
+    std::ofstream file(record_path, std::ios::binary);
+    save_session(file, session);
+  }
+
   return 0;
 }
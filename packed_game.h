@@ -0,0 +1,278 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// the standard grid shared by every game of a packed batch, as laid out by a
+// prototype breakout_t (the rules of breakout_t::step() with the built in
+// block bounce)
+struct packed_layout_t {
+  int16_t board_width_;
+  int16_t board_height_;
+  int16_t col_margin_;
+  int16_t row_margin_;
+  int16_t col_stride_; // block width + spacing
+  int16_t row_stride_; // block height + spacing
+  int16_t block_width_;
+  int16_t cols_;
+  int16_t rows_;
+  int16_t words_per_row_;
+  int16_t paddle_width_;
+  int16_t block_score_;
+  uint8_t starting_lives_;
+  uint8_t players_;
+};
+
+// everything a tick touches in one cache line, positions and velocities in
+// the smallest types the board allows, the alive bits of the blocks are kept
+// apart in packed_games_t
+struct alignas(64) packed_game_t {
+  int32_t score_;
+  int32_t tick_;
+  int32_t blocks_remaining_; // a grid can hold more than an int16 addresses
+  int16_t ball_x_;
+  int16_t ball_y_;
+  int16_t paddle_x_[2]; // the second is 0 for a single player
+  int16_t paddle_y_;
+  int8_t ball_velocity_x_;
+  int8_t ball_velocity_y_;
+  uint8_t lives_;
+  uint8_t state_; // breakout_t::game_state_e
+};
+
+static_assert(sizeof(packed_game_t) == 64, "a packed game is one cache line");
+
+// a batch of games on the same grid, each a packed_game_t in one array and
+// its alive bits (a bit per block, rows padded to whole words) in another,
+// played exactly as breakout_t plays them
+class packed_games_t {
+public:
+  using game_state_e = breakout_t::game_state_e;
+
+  // count games laid out as prototype, each restarted, throws
+  // std::invalid_argument unless the prototype uses the standard grid on a
+  // board the packed sizes can address
+  packed_games_t(const breakout_t& prototype, const int count) {
+    const blocks_t& blocks = prototype.blocks();
+    if (!blocks.rects_.empty()) {
+      throw std::invalid_argument("packed games need the standard grid");
+    }
+    for (const int extent :
+         {prototype.board_size().x_, prototype.board_size().y_,
+          blocks.col_count, blocks.row_count}) {
+      if (extent > INT16_MAX) {
+        throw std::invalid_argument("board too large for packed games");
+      }
+    }
+    layout_ = packed_layout_t{
+      int16_t(prototype.board_size().x_),
+      int16_t(prototype.board_size().y_),
+      int16_t(blocks.col_margin),
+      int16_t(blocks.row_margin),
+      int16_t(blocks.block_width + blocks.col_spacing),
+      int16_t(blocks.block_height + blocks.row_spacing),
+      int16_t(blocks.block_width),
+      int16_t(blocks.col_count),
+      int16_t(blocks.row_count),
+      int16_t((blocks.col_count + 63) / 64),
+      int16_t(prototype.paddle_width()),
+      int16_t(prototype.block_score()),
+      uint8_t(prototype.starting_lives()),
+      uint8_t(prototype.players())};
+    words_per_game_ = layout_.words_per_row_ * layout_.rows_;
+    games_.resize(count);
+    alive_.resize(size_t(words_per_game_) * count);
+    for (int game = 0; game < count; ++game) {
+      restart(game);
+    }
+  }
+
+  [[nodiscard]] int size() const { return int(games_.size()); }
+  [[nodiscard]] const packed_layout_t& layout() const { return layout_; }
+  [[nodiscard]] const packed_game_t& game(const int game) const {
+    return games_[game];
+  }
+  // memory held for the games
+  [[nodiscard]] size_t bytes() const {
+    return sizeof(*this) + games_.capacity() * sizeof(packed_game_t)
+         + alive_.capacity() * sizeof(uint64_t);
+  }
+
+  [[nodiscard]] bool block_alive(
+    const int game, const int col, const int row) const {
+    return (alive_words(game)[row * layout_.words_per_row_ + col / 64]
+            & (uint64_t(1) << (col % 64)))
+        != 0;
+  }
+
+  // the compact state of a game, as breakout_t::frame() gives it
+  [[nodiscard]] rewind_frame_t frame(const int game) const {
+    const packed_game_t& g = games_[game];
+    return rewind_frame_t{
+      g.paddle_x_[0],
+      g.paddle_x_[1],
+      g.ball_x_,
+      g.ball_y_,
+      g.ball_velocity_x_,
+      g.ball_velocity_y_,
+      g.lives_,
+      g.state_,
+      g.score_,
+      g.blocks_remaining_};
+  }
+
+  void restart(const int game) {
+    packed_game_t& g = games_[game];
+    g = packed_game_t{};
+    g.paddle_y_ = int16_t(layout_.board_height_ - 1);
+    g.paddle_x_[0] = int16_t(layout_.board_width_ / 2);
+    if (layout_.players_ == 2) {
+      g.paddle_x_[0] = int16_t(layout_.board_width_ / 3);
+      g.paddle_x_[1] =
+        int16_t(layout_.board_width_ - layout_.board_width_ / 3);
+    }
+    g.ball_x_ = g.paddle_x_[0];
+    g.ball_y_ = int16_t(g.paddle_y_ - 1);
+    g.lives_ = layout_.starting_lives_;
+    g.state_ = uint8_t(game_state_e::preparing);
+    g.blocks_remaining_ = layout_.cols_ * layout_.rows_;
+    uint64_t* alive = alive_words(game);
+    for (int row = 0; row < layout_.rows_; ++row) {
+      for (int word = 0; word < layout_.words_per_row_; ++word) {
+        const int count = std::min(64, layout_.cols_ - word * 64);
+        alive[row * layout_.words_per_row_ + word] =
+          count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+      }
+    }
+  }
+
+  void move_paddle_left(const int game, const int distance, int player = 0) {
+    packed_game_t& g = games_[game];
+    const int left_edge = g.paddle_x_[player] - layout_.paddle_width_ / 2;
+    if (left_edge > 1) {
+      g.paddle_x_[player] -= int16_t(std::min(left_edge - 1, distance));
+    }
+    try_move_ball(g);
+  }
+
+  void move_paddle_right(const int game, const int distance, int player = 0) {
+    packed_game_t& g = games_[game];
+    const int right_edge =
+      g.paddle_x_[player] + (layout_.paddle_width_ / 2 - 1);
+    if (right_edge < layout_.board_width_) {
+      g.paddle_x_[player] += int16_t(
+        std::min(layout_.board_width_ - right_edge - 1, distance));
+    }
+    try_move_ball(g);
+  }
+
+  void launch_left(const int game) { launch(games_[game], -1); }
+  void launch_right(const int game) { launch(games_[game], 1); }
+
+  void step(const int game) {
+    packed_game_t& g = games_[game];
+    g.tick_++;
+    if (g.state_ == uint8_t(game_state_e::lost_life)) {
+      g.ball_velocity_x_ = 0;
+      g.ball_velocity_y_ = 0;
+      g.ball_x_ = g.paddle_x_[0];
+      g.ball_y_ = int16_t(g.paddle_y_ - 1);
+      g.state_ = uint8_t(game_state_e::preparing);
+      return;
+    }
+    if (g.state_ != uint8_t(game_state_e::launched)) {
+      return;
+    }
+    g.ball_x_ += g.ball_velocity_x_;
+    g.ball_y_ += g.ball_velocity_y_;
+    if (g.ball_y_ == g.paddle_y_) {
+      for (int player = 0; player < layout_.players_; ++player) {
+        const int left_edge = g.paddle_x_[player] - layout_.paddle_width_ / 2;
+        const int right_edge =
+          g.paddle_x_[player] + (layout_.paddle_width_ / 2 - 1);
+        if (g.ball_x_ >= left_edge && g.ball_x_ <= right_edge) {
+          g.ball_velocity_y_ = int8_t(-g.ball_velocity_y_);
+          break;
+        }
+      }
+    }
+    if (destroy_block_at(game, g)) {
+      g.ball_velocity_y_ = int8_t(-g.ball_velocity_y_);
+      g.score_ += layout_.block_score_;
+    }
+    if (g.blocks_remaining_ == 0) {
+      g.state_ = uint8_t(game_state_e::game_complete);
+    }
+    if (g.ball_x_ >= layout_.board_width_ - 1 || g.ball_x_ <= 1) {
+      g.ball_velocity_x_ = int8_t(-g.ball_velocity_x_);
+    }
+    if (g.ball_y_ <= 0) {
+      g.ball_velocity_y_ = int8_t(-g.ball_velocity_y_);
+    }
+    if (g.ball_y_ >= layout_.board_height_) {
+      g.lives_--;
+      g.state_ = uint8_t(
+        g.lives_ == 0 ? game_state_e::game_over : game_state_e::lost_life);
+    }
+  }
+
+private:
+  packed_layout_t layout_;
+  int words_per_game_;
+  std::vector<packed_game_t> games_;
+  std::vector<uint64_t> alive_;
+
+  [[nodiscard]] uint64_t* alive_words(const int game) {
+    return &alive_[size_t(game) * words_per_game_];
+  }
+  [[nodiscard]] const uint64_t* alive_words(const int game) const {
+    return &alive_[size_t(game) * words_per_game_];
+  }
+
+  static void try_move_ball(packed_game_t& g) {
+    if (g.state_ != uint8_t(game_state_e::launched)) {
+      g.ball_x_ = g.paddle_x_[0];
+    }
+  }
+
+  static void launch(packed_game_t& g, const int direction) {
+    if (g.state_ == uint8_t(game_state_e::preparing)) {
+      g.state_ = uint8_t(game_state_e::launched);
+      g.ball_velocity_x_ = int8_t(direction);
+      g.ball_velocity_y_ = -1;
+    }
+  }
+
+  // destroys the block under the ball if there is one alive (the lowest
+  // column if blocks overlap, as the row kernel finds them)
+  bool destroy_block_at(const int game, packed_game_t& g) {
+    const int y = g.ball_y_ - layout_.row_margin_;
+    if (y < 0 || y % layout_.row_stride_ != 0) {
+      return false;
+    }
+    const int row = y / layout_.row_stride_;
+    const int x = g.ball_x_ - layout_.col_margin_;
+    if (row >= layout_.rows_ || x < 0) {
+      return false;
+    }
+    uint64_t* alive = alive_words(game) + row * layout_.words_per_row_;
+    const int last = std::min(x / layout_.col_stride_, layout_.cols_ - 1);
+    const int first = std::max(
+      (x - layout_.block_width_ + layout_.col_stride_ - 1)
+        / layout_.col_stride_,
+      0);
+    for (int col = first; col <= last; ++col) {
+      const uint64_t bit = uint64_t(1) << (col % 64);
+      if ((alive[col / 64] & bit) != 0) {
+        alive[col / 64] &= ~bit;
+        g.blocks_remaining_--;
+        return true;
+      }
+    }
+    return false;
+  }
+};
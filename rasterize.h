@@ -0,0 +1,108 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <cstdint>
+#include <cstring>
+
+// value written for each cell of a rasterized observation, where several
+// things share a downsampled cell the highest value wins
+enum raster_cell_e : uint8_t {
+  raster_empty,
+  raster_wall,
+  raster_block,
+  raster_paddle,
+  raster_ball
+};
+
+// dimensions of the observation grid, the board (border included) reduced
+// by downsample in each direction
+vec2 raster_size(const breakout_t& breakout, const int downsample) {
+  const auto [board_width, board_height] = breakout.board_size();
+  return vec2{board_width / downsample + 1, board_height / downsample + 1};
+}
+
+// fills the cells covering the board space span [x_begin, x_end] on row y,
+// drawing things in increasing value order means later spans always win
+void raster_span(
+  uint8_t* out, const vec2 size, const int downsample, const int x_begin,
+  const int x_end, const int y, const uint8_t value) {
+  const int ry = y / downsample;
+  if (ry < 0 || ry >= size.y_ || x_end < x_begin) {
+    return;
+  }
+  const int rx_begin = std::max(x_begin / downsample, 0);
+  const int rx_end = std::min(x_end / downsample, size.x_ - 1);
+  if (rx_begin <= rx_end) {
+    std::memset(out + ry * size.x_ + rx_begin, value, rx_end - rx_begin + 1);
+  }
+}
+
+// writes the board, blocks, paddles and ball as a raster_size() grid of
+// raster_cell_e values
+void rasterize(
+  const breakout_t& breakout, uint8_t* out, const int downsample = 1) {
+  const vec2 size = raster_size(breakout, downsample);
+  const auto [board_width, board_height] = breakout.board_size();
+  std::memset(out, raster_empty, size.x_ * size.y_);
+
+  raster_span(out, size, downsample, 0, board_width, 0, raster_wall);
+  raster_span(
+    out, size, downsample, 0, board_width, board_height, raster_wall);
+  for (int y = 1; y < board_height; y += downsample) {
+    const int ry = y / downsample;
+    out[ry * size.x_] = raster_wall;
+    out[ry * size.x_ + board_width / downsample] = raster_wall;
+  }
+
+  const blocks_t& blocks = breakout.blocks();
+  if (!blocks.rects_.empty()) {
+    for_each_live_block(blocks, [&](const int col, const int row) {
+      const cell_rect_t& rect = blocks.rects_[block_id(blocks, col, row)];
+      for (int y = rect.min_.y_; y <= rect.max_.y_; ++y) {
+        raster_span(
+          out, size, downsample, rect.min_.x_, rect.max_.x_, y, raster_block);
+      }
+    });
+  } else {
+    // expand each live row's alive bits into spans of block cells
+    find_live_row(blocks, [&](const int row) {
+      const int block_y =
+        blocks.row_margin + ((blocks.block_height + blocks.row_spacing) * row);
+      const block_chunk_t* chunks =
+        &blocks.chunks_[row * blocks.chunks_per_row_];
+      for (int chunk = 0; chunk < blocks.chunks_per_row_; ++chunk) {
+        for (uint64_t alive = chunks[chunk].alive_; alive != 0;
+             alive &= alive - 1) {
+          const int col = chunk * block_chunk_size + lowest_set_bit(alive);
+          const int block_x = blocks.col_margin
+                            + ((blocks.block_width + blocks.col_spacing) * col);
+          raster_span(
+            out, size, downsample, block_x, block_x + blocks.block_width - 1,
+            block_y, raster_block);
+        }
+      }
+      return false;
+    });
+  }
+
+  for (int player = 0; player < breakout.players(); ++player) {
+    raster_span(
+      out, size, downsample, breakout.paddle_left_edge(player),
+      breakout.paddle_right_edge(player), breakout.paddle_position(player).y_,
+      raster_paddle);
+  }
+  const auto [ball_x, ball_y] = breakout.ball_position();
+  raster_span(out, size, downsample, ball_x, ball_x, ball_y, raster_ball);
+}
+
+// keeps the last frames observations back to back in out (oldest first),
+// shifting the older frames down before rasterizing the newest
+void rasterize_stacked(
+  const breakout_t& breakout, uint8_t* out, const int frames,
+  const int downsample = 1) {
+  const vec2 size = raster_size(breakout, downsample);
+  const int frame_size = size.x_ * size.y_;
+  std::memmove(out, out + frame_size, size_t(frame_size) * (frames - 1));
+  rasterize(breakout, out + size_t(frame_size) * (frames - 1), downsample);
+}
@@ -0,0 +1,348 @@
+#pragma once
+
+#include "breakout.h"
+#include "glyph_table.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// what a layer holds, each drawn over the ones before it
+enum class render_layer_e : uint8_t {
+  board, // border and labels, drawn once
+  blocks, // redrawn when a block is destroyed or they come back
+  dynamic // ball, paddles and values, redrawn every frame
+};
+
+constexpr int render_layer_count = 3;
+
+// a screen area of glyph ids (no_glyph shows the layers below through)
+// which remembers the cells drawn since it was last cleared and the cells
+// changed since it was last composited, draw into it as into any display
+class render_layer_t : public glyph_display_t {
+public:
+  void resize(const vec2 origin, const vec2 size) {
+    origin_ = origin;
+    size_ = size;
+    cells_.assign(size_t(size.x_) * size.y_, no_glyph);
+    composited_cells_.assign(cells_.size(), no_glyph);
+    flags_.assign(cells_.size(), 0);
+    drawn_.clear();
+    changed_.clear();
+    all_changed_ = true;
+  }
+
+  // cells outside the layer are dropped
+  void output(int x, int y, glyph_id_t glyph) override {
+    x -= origin_.x_;
+    y -= origin_.y_;
+    if (x < 0 || y < 0 || x >= size_.x_ || y >= size_.y_) {
+      return;
+    }
+    const int index = y * size_.x_ + x;
+    cells_[index] = glyph;
+    if ((flags_[index] & drawn_flag) == 0) {
+      flags_[index] |= drawn_flag;
+      drawn_.push_back(index);
+    }
+    mark_changed(index);
+  }
+
+  // empties the cells drawn since the last clear
+  void clear() {
+    for (const int index : drawn_) {
+      cells_[index] = no_glyph;
+      flags_[index] &= ~drawn_flag;
+      mark_changed(index);
+    }
+    drawn_.clear();
+  }
+
+  [[nodiscard]] glyph_id_t glyph(const int index) const {
+    return cells_[index];
+  }
+  // true if the cell holds another glyph than it did at the last composite
+  [[nodiscard]] bool cell_changed(const int index) const {
+    return cells_[index] != composited_cells_[index];
+  }
+  // cells that may have changed since the last composite, each listed once
+  [[nodiscard]] const std::vector<int>& changed() const { return changed_; }
+  // every cell may have changed (the layer was resized)
+  [[nodiscard]] bool all_changed() const { return all_changed_; }
+  void composited() {
+    if (all_changed_) {
+      composited_cells_ = cells_;
+    }
+    for (const int index : changed_) {
+      composited_cells_[index] = cells_[index];
+      flags_[index] &= ~changed_flag;
+    }
+    changed_.clear();
+    all_changed_ = false;
+  }
+
+private:
+  static constexpr uint8_t drawn_flag = 1;
+  static constexpr uint8_t changed_flag = 2;
+
+  vec2 origin_ = {0, 0};
+  vec2 size_ = {0, 0};
+  std::vector<glyph_id_t> cells_;
+  std::vector<glyph_id_t> composited_cells_; // cells at the last composite
+  std::vector<uint8_t> flags_; // whether each cell is in drawn_ or changed_
+  std::vector<int> drawn_;
+  std::vector<int> changed_;
+  bool all_changed_ = true;
+
+  void mark_changed(const int index) {
+    if ((flags_[index] & changed_flag) == 0) {
+      flags_[index] |= changed_flag;
+      changed_.push_back(index);
+    }
+  }
+};
+
+// writes printable ascii text a glyph per character (each its own id)
+void draw_text(
+  glyph_display_t& display, const int x, const int y,
+  const std::string_view text) {
+  for (size_t i = 0; i < text.size(); ++i) {
+    display.output(x + int(i), y, glyph_id_t(text[i]));
+  }
+}
+
+// writes the decimal digits of a value (>= 0)
+void draw_number(
+  glyph_display_t& display, const int x, const int y, int value) {
+  int count = 1;
+  for (int rest = value / 10; rest != 0; rest /= 10) {
+    ++count;
+  }
+  for (int i = count - 1; i >= 0; --i, value /= 10) {
+    display.output(x + i, y, glyph_id_t('0' + value % 10));
+  }
+}
+
+// resolves glyph ids to their strings on the way out to a display
+struct glyph_resolver_t : public glyph_display_t {
+  glyph_resolver_t(const glyph_table_t& table, display_t& display)
+    : table_(table), display_(display) {}
+  void output(int x, int y, glyph_id_t glyph) override {
+    display_.output(x, y, table_.resolve(glyph));
+  }
+
+private:
+  const glyph_table_t& table_;
+  display_t& display_;
+};
+
+// a stack of layers over the same screen area, composited by emitting only
+// the cells whose topmost glyph changed since the last composite
+class render_layers_t {
+public:
+  void resize(const vec2 origin, const vec2 size) {
+    origin_ = origin;
+    size_ = size;
+    for (render_layer_t& layer : layers_) {
+      layer.resize(origin, size);
+    }
+    front_.assign(size_t(size.x_) * size.y_, no_glyph);
+    front_valid_ = false;
+  }
+
+  [[nodiscard]] vec2 origin() const { return origin_; }
+  [[nodiscard]] vec2 size() const { return size_; }
+  [[nodiscard]] render_layer_t& layer(const render_layer_e layer) {
+    return layers_[int(layer)];
+  }
+
+  // the screen no longer shows what was composited (it was cleared), the
+  // next composite emits every cell
+  void invalidate() { front_valid_ = false; }
+
+  // emits the changed cells to display (cells no layer covers as blank),
+  // returns how many were emitted
+  int composite(glyph_display_t& display, const glyph_id_t blank = ' ') {
+    int emitted = 0;
+    const auto emit = [&](const int index) {
+      glyph_id_t glyph = blank;
+      for (int layer = render_layer_count - 1; layer >= 0; --layer) {
+        if (const glyph_id_t top = layers_[layer].glyph(index);
+            top != no_glyph) {
+          glyph = top;
+          break;
+        }
+      }
+      if (!front_valid_ || front_[index] != glyph) {
+        front_[index] = glyph;
+        display.output(
+          origin_.x_ + index % size_.x_, origin_.y_ + index / size_.x_, glyph);
+        ++emitted;
+      }
+    };
+    const bool everything =
+      !front_valid_
+      || std::any_of(
+        std::begin(layers_), std::end(layers_),
+        [](const render_layer_t& layer) { return layer.all_changed(); });
+    if (everything) {
+      for (int index = 0; index < int(front_.size()); ++index) {
+        emit(index);
+      }
+    } else {
+      // a cell drawn over with the glyph it had (or cleared and drawn again)
+      // is skipped without walking the layers
+      for (const render_layer_t& layer : layers_) {
+        for (const int index : layer.changed()) {
+          if (layer.cell_changed(index)) {
+            emit(index);
+          }
+        }
+      }
+    }
+    for (render_layer_t& layer : layers_) {
+      layer.composited();
+    }
+    front_valid_ = true;
+    return emitted;
+  }
+
+private:
+  vec2 origin_ = {0, 0};
+  vec2 size_ = {0, 0};
+  render_layer_t layers_[render_layer_count];
+  std::vector<glyph_id_t> front_; // what the display shows
+  bool front_valid_ = false;
+};
+
+// the glyphs a game is drawn with
+struct breakout_glyphs_t {
+  glyph_id_t horizontal_;
+  glyph_id_t vertical_;
+  glyph_id_t top_left_;
+  glyph_id_t top_right_;
+  glyph_id_t bottom_left_;
+  glyph_id_t bottom_right_;
+  glyph_id_t paddle_;
+  glyph_id_t block_;
+  glyph_id_t ball_;
+};
+
+// columns right of the board taken by the labels
+constexpr int breakout_label_width = 20;
+
+// draws a game into layers, the board and labels once (again when the
+// board moves or is resized), the blocks whenever their version changes and
+// the ball, paddles and values every frame, once a game is over the blocks,
+// ball and paddles are hidden for the caller to draw over
+class breakout_layers_t {
+public:
+  explicit breakout_layers_t(const breakout_glyphs_t& glyphs)
+    : glyphs_(glyphs) {}
+
+  [[nodiscard]] render_layers_t& layers() { return layers_; }
+  [[nodiscard]] render_layer_t& dynamic() {
+    return layers_.layer(render_layer_e::dynamic);
+  }
+
+  // redraws everything on the next update() (the screen was cleared)
+  void invalidate() {
+    board_size_ = {0, 0};
+    layers_.invalidate();
+  }
+
+  void update(const breakout_t& breakout) {
+    const int board_y = breakout.board_offset().y_;
+    const auto [board_width, board_height] = breakout.board_size();
+    if (
+      !(breakout.board_offset() == board_offset_)
+      || !(breakout.board_size() == board_size_)) {
+      board_offset_ = breakout.board_offset();
+      board_size_ = breakout.board_size();
+      layers_.resize(
+        board_offset_,
+        vec2{board_width + 1 + breakout_label_width, board_height + 1});
+      render_layer_t& board = layers_.layer(render_layer_e::board);
+      breakout.display_board(
+        board, glyphs_.horizontal_, glyphs_.vertical_, glyphs_.top_left_,
+        glyphs_.top_right_, glyphs_.bottom_left_, glyphs_.bottom_right_);
+      draw_text(board, label_x(breakout), board_y + 1, "Lives:");
+      draw_text(board, label_x(breakout), board_y + 3, "Score:");
+      draw_text(board, label_x(breakout), board_y + 5, "Blocks:");
+      blocks_drawn_ = false;
+    }
+
+    const bool playing = breakout.state() != game_state_e::game_over
+                      && breakout.state() != game_state_e::game_complete;
+    render_layer_t& blocks = layers_.layer(render_layer_e::blocks);
+    if (blocks_drawn_ && erases_destroyed_blocks(breakout, playing)) {
+      // only the blocks a single step destroyed are gone
+      const blocks_t& game_blocks = breakout.blocks();
+      const vec2 offset = breakout.board_offset();
+      for (int i = game_blocks.remaining_; i < blocks_remaining_; ++i) {
+        const int id = game_blocks.block_ids_[i];
+        const cell_rect_t rect = block_drawn_rect(
+          game_blocks, id % game_blocks.col_count, id / game_blocks.col_count);
+        for (int x = rect.min_.x_; x <= rect.max_.x_; ++x) {
+          blocks.output(offset.x_ + x, offset.y_ + rect.min_.y_, no_glyph);
+        }
+      }
+    } else if (
+      !blocks_drawn_ || blocks_version_ != breakout.blocks_version()
+      || blocks_shown_ != playing) {
+      blocks.clear();
+      if (playing) {
+        breakout.display_blocks(blocks, glyphs_.block_);
+      }
+    }
+    blocks_drawn_ = true;
+    blocks_version_ = breakout.blocks_version();
+    layout_version_ = breakout.layout_version();
+    blocks_remaining_ = breakout.blocks_remaining();
+    blocks_shown_ = playing;
+
+    render_layer_t& dynamic = layers_.layer(render_layer_e::dynamic);
+    dynamic.clear();
+    if (playing) {
+      breakout.display_paddle(dynamic, glyphs_.paddle_);
+      breakout.display_ball(dynamic, glyphs_.ball_);
+    }
+    const int value_x = label_x(breakout) + 8;
+    draw_number(dynamic, value_x, board_y + 1, breakout.lives());
+    draw_number(dynamic, value_x, board_y + 3, breakout.score());
+    draw_number(dynamic, value_x, board_y + 5, breakout.blocks_remaining());
+  }
+
+  // the column the labels start in
+  [[nodiscard]] static int label_x(const breakout_t& breakout) {
+    return breakout.board_offset().x_ + breakout.board_size().x_ + 5;
+  }
+
+private:
+  using game_state_e = breakout_t::game_state_e;
+
+  // true if the blocks drawn differ from the game's only by the blocks one
+  // step destroyed (each step that destroys any moves the version on once,
+  // restart() and rewind() bring blocks back), on the grid where blocks
+  // never share a cell
+  [[nodiscard]] bool erases_destroyed_blocks(
+    const breakout_t& breakout, const bool playing) const {
+    const blocks_t& blocks = breakout.blocks();
+    return playing && blocks_shown_
+        && breakout.blocks_version() == blocks_version_ + 1
+        && breakout.layout_version() == layout_version_
+        && breakout.blocks_remaining() < blocks_remaining_
+        && blocks.rects_.empty() && !blocks.cell_map_.moved_;
+  }
+
+  breakout_glyphs_t glyphs_;
+  render_layers_t layers_;
+  vec2 board_offset_ = {0, 0};
+  vec2 board_size_ = {0, 0};
+  bool blocks_drawn_ = false;
+  bool blocks_shown_ = false;
+  uint32_t blocks_version_ = 0;
+  uint32_t layout_version_ = 0;
+  int blocks_remaining_ = 0;
+};
@@ -0,0 +1,74 @@
+#include "session.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// draws into a character grid that is printed once complete
+struct display_text_t : public display_t {
+  std::vector<std::string> lines_;
+
+  void output(int x, int y, std::string_view glyph) override {
+    if (y < 0 || x < 0) {
+      return;
+    }
+    if (y >= int(lines_.size())) {
+      lines_.resize(y + 1);
+    }
+    std::string& line = lines_[y];
+    if (x + glyph.size() > line.size()) {
+      line.resize(x + glyph.size(), ' ');
+    }
+    line.replace(x, glyph.size(), glyph);
+  }
+};
+
+// prints the game as it was at the given tick of a recorded session
+// usage: tdd-breakout-replay <session> <tick> [keyframe interval]
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::fprintf(
+      stderr, "usage: %s <session> <tick> [keyframe interval]\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream file(argv[1], std::ios::binary);
+  const std::optional<session_t> session = load_session(file);
+  if (!session) {
+    std::fprintf(stderr, "could not read session %s\n", argv[1]);
+    return 1;
+  }
+
+  const int keyframe_interval = argc > 3 ? std::max(std::stoi(argv[3]), 1) : 64;
+  const auto index_begin = std::chrono::steady_clock::now();
+  const session_index_t index(*session, keyframe_interval);
+  const auto index_end = std::chrono::steady_clock::now();
+
+  const int tick = std::clamp(std::stoi(argv[2]), 0, index.ticks());
+  breakout_t breakout = index.seek(tick);
+  const auto seek_end = std::chrono::steady_clock::now();
+
+  display_text_t display;
+  breakout.display_board(display, "-", "|", "+", "+", "+", "+");
+  breakout.display_blocks(display, "H");
+  breakout.display_paddle(display, "=");
+  breakout.display_ball(display, "o");
+  for (const std::string& line : display.lines_) {
+    std::printf("%s\n", line.c_str());
+  }
+
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  std::printf(
+    "tick %d/%d  lives %d  score %d  blocks %d\n", tick, index.ticks(),
+    breakout.lives(), breakout.score(), breakout.blocks_remaining());
+  std::printf(
+    "indexed in %lldus, seek took %lldus\n",
+    static_cast<long long>(
+      duration_cast<microseconds>(index_end - index_begin).count()),
+    static_cast<long long>(
+      duration_cast<microseconds>(seek_end - index_end).count()));
+  return 0;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// sse2 is the baseline of x86-64, 32 bit x86 only has it when targeted
+#if defined(__x86_64__) || defined(_M_X64) \
+  || (defined(__i386__) && defined(__SSE2__)) \
+  || (defined(_M_IX86) && defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BREAKOUT_ROW_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// the blocks of a row run of up to 64 blocks, where block i covers the
+// columns [x_ + stride_ * i, x_ + stride_ * i + width_]
+struct row_extents_t {
+  int x_;
+  int stride_;
+  int width_;
+  int count_;
+};
+
+// bit set for each block in the run whose extent contains x
+uint64_t row_hit_mask_scalar(const row_extents_t& row, const int x) {
+  uint64_t mask = 0;
+  for (int i = 0; i < row.count_; ++i) {
+    const int block_x = row.x_ + row.stride_ * i;
+    if (x >= block_x && x <= block_x + row.width_) {
+      mask |= uint64_t(1) << i;
+    }
+  }
+  return mask;
+}
+
+// hit masks for several balls against the same run of blocks
+void row_hit_masks_scalar(
+  const row_extents_t& row, const int* xs, const int count, uint64_t* masks) {
+  for (int i = 0; i < count; ++i) {
+    masks[i] = row_hit_mask_scalar(row, xs[i]);
+  }
+}
+
+uint64_t count_mask(const int count) {
+  return count >= 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+}
+
+#ifdef BREAKOUT_ROW_KERNEL_X86
+
+uint64_t row_hit_mask_sse2(const row_extents_t& row, const int x) {
+  const __m128i xs = _mm_set1_epi32(x);
+  const __m128i step = _mm_set1_epi32(row.stride_ * 4);
+  const __m128i width = _mm_set1_epi32(row.width_);
+  // sse2 has no 32 bit multiply so build the first lanes by hand
+  __m128i lo = _mm_setr_epi32(
+    row.x_, row.x_ + row.stride_, row.x_ + row.stride_ * 2,
+    row.x_ + row.stride_ * 3);
+  uint64_t mask = 0;
+  for (int i = 0; i < row.count_; i += 4) {
+    const __m128i hi = _mm_add_epi32(lo, width);
+    const __m128i miss =
+      _mm_or_si128(_mm_cmpgt_epi32(lo, xs), _mm_cmpgt_epi32(xs, hi));
+    const int hits = ~_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xf;
+    mask |= uint64_t(hits) << i;
+    lo = _mm_add_epi32(lo, step);
+  }
+  return mask & count_mask(row.count_);
+}
+
+// the balls four at a time, one lane each, against every block in turn (a
+// ball hits at most a couple of blocks so lanes rarely need setting)
+void row_hit_masks_sse2(
+  const row_extents_t& row, const int* xs, const int count, uint64_t* masks) {
+  int first = 0;
+  for (; first + 4 <= count; first += 4) {
+    const __m128i x =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + first));
+    uint64_t lanes[4] = {};
+    int block_x = row.x_;
+    for (int i = 0; i < row.count_; ++i, block_x += row.stride_) {
+      const __m128i miss = _mm_or_si128(
+        _mm_cmpgt_epi32(_mm_set1_epi32(block_x), x),
+        _mm_cmpgt_epi32(x, _mm_set1_epi32(block_x + row.width_)));
+      if (const int hits = ~_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xf;
+          hits != 0) {
+        for (int lane = 0; lane < 4; ++lane) {
+          lanes[lane] |= uint64_t((hits >> lane) & 1) << i;
+        }
+      }
+    }
+    std::copy(lanes, lanes + 4, masks + first);
+  }
+  for (; first < count; ++first) {
+    masks[first] = row_hit_mask_sse2(row, xs[first]);
+  }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+uint64_t row_hit_mask_avx2(const row_extents_t& row, const int x) {
+  const __m256i xs = _mm256_set1_epi32(x);
+  const __m256i step = _mm256_set1_epi32(row.stride_ * 8);
+  const __m256i width = _mm256_set1_epi32(row.width_);
+  __m256i lo = _mm256_add_epi32(
+    _mm256_set1_epi32(row.x_),
+    _mm256_mullo_epi32(
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+      _mm256_set1_epi32(row.stride_)));
+  uint64_t mask = 0;
+  for (int i = 0; i < row.count_; i += 8) {
+    const __m256i hi = _mm256_add_epi32(lo, width);
+    const __m256i miss =
+      _mm256_or_si256(_mm256_cmpgt_epi32(lo, xs), _mm256_cmpgt_epi32(xs, hi));
+    const int hits = ~_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xff;
+    mask |= uint64_t(hits) << i;
+    lo = _mm256_add_epi32(lo, step);
+  }
+  return mask & count_mask(row.count_);
+}
+
+// as row_hit_masks_sse2, eight balls at a time
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+void row_hit_masks_avx2(
+  const row_extents_t& row, const int* xs, const int count, uint64_t* masks) {
+  int first = 0;
+  for (; first + 8 <= count; first += 8) {
+    const __m256i x =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs + first));
+    uint64_t lanes[8] = {};
+    int block_x = row.x_;
+    for (int i = 0; i < row.count_; ++i, block_x += row.stride_) {
+      const __m256i miss = _mm256_or_si256(
+        _mm256_cmpgt_epi32(_mm256_set1_epi32(block_x), x),
+        _mm256_cmpgt_epi32(x, _mm256_set1_epi32(block_x + row.width_)));
+      if (const int hits =
+            ~_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xff;
+          hits != 0) {
+        for (int lane = 0; lane < 8; ++lane) {
+          lanes[lane] |= uint64_t((hits >> lane) & 1) << i;
+        }
+      }
+    }
+    std::copy(lanes, lanes + 8, masks + first);
+  }
+  for (; first < count; ++first) {
+    masks[first] = row_hit_mask_avx2(row, xs[first]);
+  }
+}
+
+bool cpu_supports_avx2() {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  // avx itself and osxsave, without which xgetbv is not there to ask
+  // whether the os saves the ymm registers
+  __cpuid(info, 1);
+  const bool os_saves_ymm = (info[2] & (1 << 28)) != 0
+                         && (info[2] & (1 << 27)) != 0
+                         && (_xgetbv(0) & 0x6) == 0x6;
+  __cpuidex(info, 7, 0);
+  return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+  return false;
+#endif
+}
+
+#endif
+
+using row_hit_mask_fn_t = uint64_t (*)(const row_extents_t& row, int x);
+using row_hit_masks_fn_t = void (*)(
+  const row_extents_t& row, const int* xs, int count, uint64_t* masks);
+
+struct row_kernel_t {
+  row_hit_mask_fn_t hit_mask_; // one ball, the blocks a vector at a time
+  row_hit_masks_fn_t hit_masks_; // many balls, the balls a vector at a time
+  const char* name_;
+};
+
+// widest kernel the cpu supports, picked once on first use (callers keep
+// the kernel rather than asking for it on every lookup)
+const row_kernel_t& row_kernel() {
+  static const row_kernel_t kernel = [] {
+#ifdef BREAKOUT_ROW_KERNEL_X86
+    if (cpu_supports_avx2()) {
+      return row_kernel_t{row_hit_mask_avx2, row_hit_masks_avx2, "avx2"};
+    }
+    return row_kernel_t{row_hit_mask_sse2, row_hit_masks_sse2, "sse2"};
+#else
+    return row_kernel_t{row_hit_mask_scalar, row_hit_masks_scalar, "scalar"};
+#endif
+  }();
+  return kernel;
+}
@@ -0,0 +1,359 @@
+#include "state_update.h"
+#include "timer_wheel.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// hosts a game for every client connected to a unix domain socket in one
+// process, an epoll loop handles the sockets and a single timer wheel steps
+// every game on its own 100ms period, each step sends the client a compact
+// state update (see state_update.h)
+// usage: tdd-breakout-server serve <socket path>
+//        tdd-breakout-server load <socket path> <clients> [seconds]
+// (load connects many clients that steer towards the ball, reporting the
+// rate of updates received)
+
+namespace {
+
+// one byte sent by a client for each action
+enum client_action_e : uint8_t {
+  client_noop,
+  client_left,
+  client_right,
+  client_launch // also restarts a finished game
+};
+
+constexpr int wheel_tick_ms = 10;
+constexpr int step_period_ticks = 10; // 100ms, as in the game itself
+constexpr int paddle_speed = 2;
+constexpr uint64_t listen_token = ~uint64_t(0);
+constexpr uint64_t timer_token = ~uint64_t(0) - 1;
+
+volatile std::sig_atomic_t running = 1;
+
+sockaddr_un socket_address(const char* path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  return address;
+}
+
+struct client_t {
+  int fd_ = -1;
+  uint32_t generation_ = 0; // bumped on disconnect to drop stale timers
+  uint32_t tick_ = 0;
+  breakout_t game_;
+  update_cursor_t cursor_;
+};
+
+class server_t {
+public:
+  server_t(const int listen_fd, const int epoll_fd)
+    : listen_fd_(listen_fd), epoll_fd_(epoll_fd), wheel_(64) {}
+
+  [[nodiscard]] int connected() const { return connected_; }
+  [[nodiscard]] uint64_t steps() const { return steps_; }
+
+  void accept_clients() {
+    while (true) {
+      const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+      if (fd < 0) {
+        return;
+      }
+      int slot = 0;
+      if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+      } else {
+        slot = int(clients_.size());
+        clients_.emplace_back();
+      }
+      client_t& client = clients_[slot];
+      client.fd_ = fd;
+      client.tick_ = 0;
+      client.game_.setup(0, 0, 101, 30);
+      client.cursor_ = update_cursor_t{};
+      epoll_event event{EPOLLIN, {}};
+      event.data.u64 = uint64_t(slot);
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+      wheel_.schedule(token(slot), step_period_ticks);
+      ++connected_;
+    }
+  }
+
+  void read_client(const int slot) {
+    client_t& client = clients_[slot];
+    if (client.fd_ < 0) {
+      return; // disconnected earlier in the same batch of events
+    }
+    while (true) {
+      uint8_t actions[64];
+      const ssize_t size = recv(client.fd_, actions, sizeof(actions), 0);
+      if (size == 0 || (size < 0 && errno != EAGAIN)) {
+        disconnect(slot);
+        return;
+      }
+      if (size < 0) {
+        return;
+      }
+      for (ssize_t i = 0; i < size; ++i) {
+        act(client, actions[i]);
+      }
+    }
+  }
+
+  // runs the wheel on by however many ticks the timer has counted
+  void run_timers(const uint64_t ticks) {
+    for (uint64_t i = 0; i < ticks; ++i) {
+      wheel_.advance([this](const uint64_t token) { step_client(token); });
+    }
+  }
+
+private:
+  int listen_fd_;
+  int epoll_fd_;
+  timer_wheel_t wheel_;
+  std::vector<client_t> clients_;
+  std::vector<int> free_slots_;
+  std::vector<uint8_t> update_; // reused for every update sent
+  int connected_ = 0;
+  uint64_t steps_ = 0;
+
+  uint64_t token(const int slot) const {
+    return (uint64_t(clients_[slot].generation_) << 32) | uint32_t(slot);
+  }
+
+  static void act(client_t& client, const uint8_t action) {
+    breakout_t& game = client.game_;
+    switch (action) {
+      case client_left:
+        game.move_paddle_left(paddle_speed);
+        break;
+      case client_right:
+        game.move_paddle_right(paddle_speed);
+        break;
+      case client_launch:
+        if (
+          game.state() == breakout_t::game_state_e::game_over
+          || game.state() == breakout_t::game_state_e::game_complete) {
+          game.restart();
+          client.cursor_ = update_cursor_t{};
+        } else {
+          game.launch_left();
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  void step_client(const uint64_t token) {
+    const int slot = int(token & 0xffffffff);
+    client_t& client = clients_[slot];
+    if (client.fd_ < 0 || client.generation_ != uint32_t(token >> 32)) {
+      return; // disconnected since this was scheduled
+    }
+    client.game_.step();
+    ++client.tick_;
+    ++steps_;
+
+    update_.clear();
+    encode_state_update(client.game_, client.tick_, client.cursor_, update_);
+    const ssize_t sent =
+      send(client.fd_, update_.data(), update_.size(), MSG_NOSIGNAL);
+    if (sent == ssize_t(update_.size())) {
+      client.cursor_.blocks_remaining_ = client.game_.blocks_remaining();
+    } else if (sent < 0 && errno != EAGAIN) {
+      disconnect(slot);
+      return;
+    }
+    // a client too slow to take the update catches up with the next one
+    wheel_.schedule(this->token(slot), step_period_ticks);
+  }
+
+  void disconnect(const int slot) {
+    client_t& client = clients_[slot];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client.fd_, nullptr);
+    close(client.fd_);
+    client.fd_ = -1;
+    ++client.generation_;
+    free_slots_.push_back(slot);
+    --connected_;
+  }
+};
+
+int serve(const char* path) {
+  const sockaddr_un address = socket_address(path);
+  const int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+  unlink(path);
+  if (
+    listen_fd < 0
+    || bind(
+         listen_fd, reinterpret_cast<const sockaddr*>(&address),
+         sizeof(address))
+         < 0
+    || listen(listen_fd, SOMAXCONN) < 0) {
+    std::perror("listen");
+    return 1;
+  }
+
+  const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  const timespec period{0, wheel_tick_ms * 1000000};
+  const itimerspec timer{period, period};
+  timerfd_settime(timer_fd, 0, &timer, nullptr);
+
+  const int epoll_fd = epoll_create1(0);
+  epoll_event event{EPOLLIN, {}};
+  event.data.u64 = listen_token;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+  event.data.u64 = timer_token;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+
+  server_t server(listen_fd, epoll_fd);
+  std::printf("serving on %s\n", path);
+  std::fflush(stdout);
+
+  auto report_time = std::chrono::steady_clock::now();
+  uint64_t report_steps = 0;
+  std::vector<epoll_event> events(256);
+  while (running != 0) {
+    const int count =
+      epoll_wait(epoll_fd, events.data(), int(events.size()), 1000);
+    for (int i = 0; i < count; ++i) {
+      const uint64_t token = events[i].data.u64;
+      if (token == listen_token) {
+        server.accept_clients();
+      } else if (token == timer_token) {
+        uint64_t expirations = 0;
+        if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+          server.run_timers(expirations);
+        }
+      } else {
+        server.read_client(int(token));
+      }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - report_time >= std::chrono::seconds(5)) {
+      const double seconds =
+        std::chrono::duration<double>(now - report_time).count();
+      std::printf(
+        "%d clients, %.0f steps/s\n", server.connected(),
+        double(server.steps() - report_steps) / seconds);
+      std::fflush(stdout);
+      report_time = now;
+      report_steps = server.steps();
+    }
+  }
+
+  close(epoll_fd);
+  close(timer_fd);
+  close(listen_fd);
+  unlink(path);
+  return 0;
+}
+
+// connects client_count clients that play by following the ball
+int load(const char* path, const int client_count, const int seconds) {
+  const sockaddr_un address = socket_address(path);
+  const int epoll_fd = epoll_create1(0);
+  std::vector<int> fds;
+  for (int i = 0; i < client_count; ++i) {
+    const int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (
+      fd < 0
+      || connect(
+           fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address))
+           < 0) {
+      std::perror("connect");
+      break;
+    }
+    epoll_event event{EPOLLIN, {}};
+    event.data.u64 = uint64_t(fds.size());
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    fds.push_back(fd);
+  }
+
+  uint64_t updates = 0;
+  uint64_t bytes = 0;
+  uint64_t malformed = 0;
+  state_update_t update;
+  std::vector<epoll_event> events(256);
+  const auto begin = std::chrono::steady_clock::now();
+  const auto end = begin + std::chrono::seconds(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    const int count =
+      epoll_wait(epoll_fd, events.data(), int(events.size()), 100);
+    for (int i = 0; i < count; ++i) {
+      const int fd = fds[events[i].data.u64];
+      uint8_t buffer[4096];
+      const ssize_t size = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+      if (size <= 0) {
+        continue;
+      }
+      ++updates;
+      bytes += uint64_t(size);
+      if (!decode_state_update(buffer, buffer + size, update)) {
+        ++malformed;
+        continue;
+      }
+      const rewind_frame_t& frame = update.frame_;
+      uint8_t action = client_noop;
+      if (frame.state_ != uint8_t(breakout_t::game_state_e::launched)) {
+        action = client_launch;
+      } else if (frame.paddle_x_ > frame.ball_x_ + 1) {
+        action = client_left;
+      } else if (frame.paddle_x_ < frame.ball_x_ - 1) {
+        action = client_right;
+      }
+      if (action != client_noop) {
+        send(fd, &action, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+      }
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - begin)
+                           .count();
+
+  std::printf(
+    "%d clients: %.0f updates/s, %.1f bytes per update, %llu malformed\n",
+    int(fds.size()), double(updates) / elapsed,
+    updates == 0 ? 0.0 : double(bytes) / double(updates),
+    static_cast<unsigned long long>(malformed));
+  for (const int fd : fds) {
+    close(fd);
+  }
+  close(epoll_fd);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc >= 3 && std::strcmp(argv[1], "serve") == 0) {
+    std::signal(SIGINT, [](int) { running = 0; });
+    std::signal(SIGTERM, [](int) { running = 0; });
+    return serve(argv[2]);
+  }
+  if (argc >= 4 && std::strcmp(argv[1], "load") == 0) {
+    return load(
+      argv[2], std::stoi(argv[3]), argc > 4 ? std::stoi(argv[4]) : 5);
+  }
+  std::fprintf(
+    stderr,
+    "usage: %s serve <socket path>\n"
+    "       %s load <socket path> <clients> [seconds]\n",
+    argv[0], argv[0]);
+  return 1;
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "breakout.h"
+#include "level_search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a recorded play session, the game setup followed by every input made
+struct session_t {
+  vec2 board_offset_;
+  vec2 board_size_;
+  int rewind_ticks_; // rewind history the game was recorded with (0 for none)
+  std::vector<cell_rect_t> level_ = {}; // level played (empty for the grid)
+  std::vector<uint8_t> inputs_ = {}; // see breakout_t::set_input_log
+};
+
+constexpr std::string_view session_magic = "breakout-session";
+constexpr int session_version = 2;
+
+// a text header line, the level (see save_level) if one was played and then
+// the raw input log
+void save_session(std::ostream& out, const session_t& session) {
+  out << session_magic << ' ' << session_version << ' '
+      << session.board_offset_.x_ << ' ' << session.board_offset_.y_ << ' '
+      << session.board_size_.x_ << ' ' << session.board_size_.y_ << ' '
+      << session.rewind_ticks_ << ' ' << !session.level_.empty() << ' '
+      << session.inputs_.size() << '\n';
+  if (!session.level_.empty()) {
+    save_level(out, session.level_);
+  }
+  out.write(
+    reinterpret_cast<const char*>(session.inputs_.data()),
+    std::streamsize(session.inputs_.size()));
+}
+
+std::optional<session_t> load_session(std::istream& in) {
+  std::string magic;
+  int version = 0;
+  bool has_level = false;
+  size_t input_count = 0;
+  session_t session;
+  in >> magic >> version >> session.board_offset_.x_
+    >> session.board_offset_.y_ >> session.board_size_.x_
+    >> session.board_size_.y_ >> session.rewind_ticks_ >> has_level
+    >> input_count;
+  if (!in || magic != session_magic || version != session_version) {
+    return {};
+  }
+  if (has_level) {
+    auto level = load_level(in);
+    if (!level) {
+      return {};
+    }
+    session.level_ = std::move(*level);
+  }
+  in.get(); // end of the header line
+  session.inputs_.resize(input_count);
+  in.read(
+    reinterpret_cast<char*>(session.inputs_.data()),
+    std::streamsize(input_count));
+  if (!in) {
+    return {};
+  }
+  return session;
+}
+
+// a game set up the way the session was recorded
+breakout_t start_session(const session_t& session) {
+  breakout_t breakout;
+  breakout.setup(
+    session.board_offset_.x_, session.board_offset_.y_,
+    session.board_size_.x_, session.board_size_.y_);
+  if (session.rewind_ticks_ > 0) {
+    breakout.enable_rewind(session.rewind_ticks_);
+  }
+  if (!session.level_.empty()) {
+    breakout.set_layout_blocks_fn(level_blocks_fn(session.level_));
+    breakout.restart();
+  }
+  return breakout;
+}
+
+// random access to every tick of a session, a full copy of the game is kept
+// every keyframe_interval ticks and the compact state of every tick between
+class session_index_t {
+public:
+  session_index_t(
+    const session_t& session, const int keyframe_interval,
+    const int thread_count = int(std::thread::hardware_concurrency()))
+    : session_(session), keyframe_interval_(keyframe_interval) {
+    build_keyframes();
+    build_frames(std::max(thread_count, 1));
+  }
+
+  // ticks in the session (tick 0 is the state before the first step)
+  [[nodiscard]] int ticks() const { return int(frames_.size()) - 1; }
+
+  // compact state of the game at the end of tick
+  [[nodiscard]] const rewind_frame_t& frame(const int tick) const {
+    return frames_[tick];
+  }
+
+  // the game as it was at the end of tick, restored from the keyframe before
+  // it so at most keyframe_interval ticks are replayed
+  [[nodiscard]] breakout_t seek(const int tick) const {
+    const keyframe_t& keyframe = keyframes_[tick / keyframe_interval_];
+    breakout_t breakout = keyframe.breakout_;
+    replay_until(breakout, keyframe.input_, keyframe.tick_, tick);
+    return breakout;
+  }
+
+private:
+  struct keyframe_t {
+    breakout_t breakout_;
+    int tick_;
+    size_t input_; // offset of the first input after the keyframe
+  };
+
+  session_t session_;
+  int keyframe_interval_;
+  std::vector<keyframe_t> keyframes_;
+  std::vector<rewind_frame_t> frames_;
+
+  // applies inputs until the game reaches the end of tick end_tick (or the
+  // inputs run out), returning the offset of the next input
+  size_t replay_until(
+    breakout_t& breakout, size_t input, int tick, const int end_tick,
+    rewind_frame_t* frames = nullptr) const {
+    const auto& inputs = session_.inputs_;
+    while (tick < end_tick && input < inputs.size()) {
+      const bool step = inputs[input] == uint8_t(input_op_e::step);
+      input = replay_input(breakout, inputs, input);
+      if (step) {
+        ++tick;
+        if (frames != nullptr) {
+          *frames++ = breakout.frame();
+        }
+      }
+    }
+    return input;
+  }
+
+  // like replay_until but without the per tick states, so each run of steps
+  // is played with step_n() (jumping the ticks the ball flies freely)
+  size_t skip_until(
+    breakout_t& breakout, size_t input, int tick, const int end_tick) const {
+    const auto& inputs = session_.inputs_;
+    while (tick < end_tick && input < inputs.size()) {
+      if (inputs[input] != uint8_t(input_op_e::step)) {
+        input = replay_input(breakout, inputs, input);
+        continue;
+      }
+      int steps = 0;
+      while (tick + steps < end_tick && input + steps < inputs.size()
+             && inputs[input + steps] == uint8_t(input_op_e::step)) {
+        ++steps;
+      }
+      for (int played = 0; played < steps;) {
+        played += breakout.step_n(steps - played).ticks_;
+      }
+      input += size_t(steps);
+      tick += steps;
+    }
+    return input;
+  }
+
+  // the game state at each keyframe depends on every tick before it so the
+  // keyframes come from a single pass over the inputs, which skips what it
+  // can as the per tick states are left to build_frames()
+  void build_keyframes() {
+    const auto& inputs = session_.inputs_;
+    int total_ticks = 0;
+    for (size_t input = 0; input < inputs.size();) {
+      const auto op = static_cast<input_op_e>(inputs[input]);
+      total_ticks += op == input_op_e::step ? 1 : 0;
+      input += input_op_has_arg(op) ? 3 : 1;
+    }
+    frames_.resize(total_ticks + 1);
+
+    breakout_t breakout = start_session(session_);
+    size_t input = 0;
+    for (int tick = 0; tick <= total_ticks; tick += keyframe_interval_) {
+      input = skip_until(
+        breakout, input, std::max(tick - keyframe_interval_, 0), tick);
+      keyframes_.push_back(keyframe_t{breakout, tick, input});
+    }
+  }
+
+  // per tick states are filled in for each keyframe interval in parallel
+  void build_frames(const int thread_count) {
+    std::atomic<int> next_keyframe = 0;
+    const auto worker = [this, &next_keyframe] {
+      for (int k = next_keyframe++; k < int(keyframes_.size());
+           k = next_keyframe++) {
+        const keyframe_t& keyframe = keyframes_[k];
+        breakout_t breakout = keyframe.breakout_;
+        frames_[keyframe.tick_] = breakout.frame();
+        const int end_tick =
+          std::min(keyframe.tick_ + keyframe_interval_ - 1, ticks());
+        replay_until(
+          breakout, keyframe.input_, keyframe.tick_, end_tick,
+          frames_.data() + keyframe.tick_ + 1);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < thread_count; ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+};
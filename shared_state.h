@@ -0,0 +1,211 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BREAKOUT_SHARED_STATE_POSIX
+#endif
+
+// blocks covered by the alive bitmap of a published record
+constexpr int shared_state_max_blocks = 4096;
+constexpr uint32_t shared_state_magic = 0x42524b31; // "BRK1"
+
+// fixed layout snapshot of a game, as published for other processes
+struct shared_state_record_t {
+  uint32_t tick_;
+  int32_t board_width_;
+  int32_t board_height_;
+  int32_t players_;
+  int32_t paddle_x_[2];
+  int32_t paddle_width_;
+  int32_t ball_x_;
+  int32_t ball_y_;
+  int32_t ball_velocity_x_;
+  int32_t ball_velocity_y_;
+  int32_t lives_;
+  int32_t score_;
+  int32_t state_; // breakout_t::game_state_e
+  int32_t block_cols_;
+  int32_t block_count_; // block ids past shared_state_max_blocks are left out
+  int32_t blocks_remaining_;
+  uint64_t alive_[shared_state_max_blocks / 64]; // bit per block id
+};
+
+constexpr size_t shared_state_words =
+  (sizeof(shared_state_record_t) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+// the shared segment, the record is guarded by a seqlock, the sequence is
+// odd while a write is in progress and readers retry if it moved while they
+// copied, the words are atomics so concurrent copies are well defined
+struct shared_state_t {
+  uint32_t magic_;
+  std::atomic<uint32_t> sequence_;
+  std::atomic<uint64_t> words_[shared_state_words];
+};
+
+static_assert(
+  std::atomic<uint64_t>::is_always_lock_free
+    && std::atomic<uint32_t>::is_always_lock_free,
+  "shared state must be lock free to work across processes");
+
+shared_state_record_t make_shared_state_record(
+  const breakout_t& breakout, const uint32_t tick) {
+  shared_state_record_t record = {};
+  record.tick_ = tick;
+  record.board_width_ = breakout.board_size().x_;
+  record.board_height_ = breakout.board_size().y_;
+  record.players_ = breakout.players();
+  for (int player = 0; player < breakout.players(); ++player) {
+    record.paddle_x_[player] = breakout.paddle_position(player).x_;
+  }
+  record.paddle_width_ = breakout.paddle_width();
+  record.ball_x_ = breakout.ball_position().x_;
+  record.ball_y_ = breakout.ball_position().y_;
+  record.ball_velocity_x_ = breakout.ball_velocity().x_;
+  record.ball_velocity_y_ = breakout.ball_velocity().y_;
+  record.lives_ = breakout.lives();
+  record.score_ = breakout.score();
+  record.state_ = int32_t(breakout.state());
+
+  const blocks_t& blocks = breakout.blocks();
+  record.block_cols_ = blocks.col_count;
+  record.block_count_ =
+    std::min(int(blocks.block_ids_.size()), shared_state_max_blocks);
+  record.blocks_remaining_ = blocks.remaining_;
+  for (int i = 0; i < blocks.remaining_; ++i) {
+    const int id = blocks.block_ids_[i];
+    if (id < shared_state_max_blocks) {
+      record.alive_[id / 64] |= uint64_t(1) << (id % 64);
+    }
+  }
+  return record;
+}
+
+// only ever called by the single writer
+void write_shared_state(
+  shared_state_t& state, const shared_state_record_t& record) {
+  uint64_t words[shared_state_words] = {};
+  std::memcpy(words, &record, sizeof(record));
+  const uint32_t sequence = state.sequence_.load(std::memory_order_relaxed);
+  state.sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < shared_state_words; ++i) {
+    state.words_[i].store(words[i], std::memory_order_relaxed);
+  }
+  state.sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+// copies a consistent record, retrying while a write gets in the way, false
+// if nothing has been written yet or the writer kept it busy for every try
+bool read_shared_state(
+  const shared_state_t& state, shared_state_record_t& record,
+  int attempts = 1000) {
+  uint64_t words[shared_state_words];
+  for (; attempts > 0; --attempts) {
+    const uint32_t before = state.sequence_.load(std::memory_order_acquire);
+    if (before == 0 || (before & 1) != 0) {
+      continue;
+    }
+    for (size_t i = 0; i < shared_state_words; ++i) {
+      words[i] = state.words_[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (state.sequence_.load(std::memory_order_relaxed) == before) {
+      std::memcpy(&record, words, sizeof(record));
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef BREAKOUT_SHARED_STATE_POSIX
+
+// owns a named posix shared memory segment holding a shared_state_t, the
+// publisher creates (and on destruction removes) it, readers map it read only
+class shared_state_mapping_t {
+public:
+  static shared_state_mapping_t publish(const char* name) {
+    shared_state_mapping_t mapping;
+    const int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+      return mapping;
+    }
+    if (ftruncate(fd, sizeof(shared_state_t)) == 0) {
+      void* memory = mmap(
+        nullptr, sizeof(shared_state_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd, 0);
+      if (memory != MAP_FAILED) {
+        mapping.state_ = new (memory) shared_state_t{};
+        mapping.state_->magic_ = shared_state_magic;
+        mapping.name_ = name;
+      }
+    }
+    close(fd);
+    return mapping;
+  }
+
+  static shared_state_mapping_t observe(const char* name) {
+    shared_state_mapping_t mapping;
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+      return mapping;
+    }
+    struct stat status = {};
+    if (
+      fstat(fd, &status) != 0
+      || status.st_size < off_t(sizeof(shared_state_t))) {
+      close(fd); // not sized by the publisher yet
+      return mapping;
+    }
+    void* memory =
+      mmap(nullptr, sizeof(shared_state_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory != MAP_FAILED) {
+      mapping.state_ = static_cast<shared_state_t*>(memory);
+      if (mapping.state_->magic_ != shared_state_magic) {
+        mapping = shared_state_mapping_t{};
+      }
+    }
+    return mapping;
+  }
+
+  shared_state_mapping_t() = default;
+  shared_state_mapping_t(shared_state_mapping_t&& other) noexcept
+    : state_(std::exchange(other.state_, nullptr)),
+      name_(std::move(other.name_)) {
+    other.name_.clear();
+  }
+  shared_state_mapping_t& operator=(shared_state_mapping_t&& other) noexcept {
+    std::swap(state_, other.state_);
+    std::swap(name_, other.name_);
+    return *this;
+  }
+  ~shared_state_mapping_t() {
+    if (state_ != nullptr) {
+      munmap(state_, sizeof(shared_state_t));
+    }
+    if (!name_.empty()) {
+      shm_unlink(name_.c_str());
+    }
+  }
+
+  [[nodiscard]] bool valid() const { return state_ != nullptr; }
+  [[nodiscard]] shared_state_t& state() const { return *state_; }
+
+private:
+  shared_state_t* state_ = nullptr;
+  std::string name_; // set for the publisher only
+};
+
+#endif
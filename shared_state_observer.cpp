@@ -0,0 +1,53 @@
+#include "shared_state.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// prints snapshots of a game published with tdd-breakout --publish <name>
+// usage: tdd-breakout-observer <name> [interval ms] [snapshots]
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(
+      stderr, "usage: %s <name> [interval ms] [snapshots]\n", argv[0]);
+    return 1;
+  }
+  const auto interval =
+    std::chrono::milliseconds(argc > 2 ? std::stoi(argv[2]) : 100);
+  const int snapshots = argc > 3 ? std::stoi(argv[3]) : -1;
+
+  const shared_state_mapping_t mapping =
+    shared_state_mapping_t::observe(argv[1]);
+  if (!mapping.valid()) {
+    std::fprintf(stderr, "nothing published as %s\n", argv[1]);
+    return 1;
+  }
+
+  for (int i = 0; snapshots < 0 || i < snapshots; ++i) {
+    shared_state_record_t record;
+    if (read_shared_state(mapping.state(), record)) {
+      // live blocks per row, from the bitmap
+      std::string rows;
+      const int row_count =
+        record.block_cols_ == 0 ? 0 : record.block_count_ / record.block_cols_;
+      for (int row = 0; row < row_count; ++row) {
+        int alive = 0;
+        for (int col = 0; col < record.block_cols_; ++col) {
+          const int id = row * record.block_cols_ + col;
+          alive += int((record.alive_[id / 64] >> (id % 64)) & 1);
+        }
+        rows += std::to_string(alive) + ' ';
+      }
+      std::printf(
+        "tick %u state %d lives %d score %d ball %d,%d paddle %d blocks %d "
+        "[ %s]\n",
+        record.tick_, record.state_, record.lives_, record.score_,
+        record.ball_x_, record.ball_y_, record.paddle_x_[0],
+        record.blocks_remaining_, rows.c_str());
+      std::fflush(stdout);
+    }
+    std::this_thread::sleep_for(interval);
+  }
+  return 0;
+}
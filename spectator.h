@@ -0,0 +1,387 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// an encoded frame, shared by every subscriber it is sent to
+using spectator_frame_t = std::shared_ptr<const std::vector<uint8_t>>;
+
+class bit_writer_t {
+public:
+  void put(const uint64_t value, const int bits) {
+    for (int i = bits - 1; i >= 0; --i) {
+      if (bit_ % 8 == 0) {
+        bytes_.push_back(0);
+      }
+      bytes_.back() |= uint8_t(((value >> i) & 1) << (7 - bit_ % 8));
+      ++bit_;
+    }
+  }
+
+  // exp-golomb code, small values take few bits (0 takes one)
+  void put_unsigned(const uint32_t value) {
+    const uint64_t coded = uint64_t(value) + 1;
+    int bits = 0;
+    while ((coded >> bits) > 1) {
+      ++bits;
+    }
+    put(0, bits);
+    put(coded, bits + 1);
+  }
+
+  void put_signed(const int32_t value) {
+    put_unsigned((uint32_t(value) << 1) ^ uint32_t(value >> 31));
+  }
+
+  [[nodiscard]] std::vector<uint8_t> take() {
+    bit_ = 0;
+    return std::move(bytes_);
+  }
+
+private:
+  std::vector<uint8_t> bytes_;
+  size_t bit_ = 0;
+};
+
+class bit_reader_t {
+public:
+  bit_reader_t(const uint8_t* bytes, const size_t size)
+    : bytes_(bytes), size_(size) {}
+
+  // true while every read so far stayed inside the buffer
+  [[nodiscard]] bool ok() const { return bit_ <= size_ * 8; }
+  [[nodiscard]] size_t bits_left() const {
+    return ok() ? size_ * 8 - bit_ : 0;
+  }
+
+  uint32_t get(const int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; ++i, ++bit_) {
+      const uint32_t bit =
+        bit_ < size_ * 8 ? (bytes_[bit_ / 8] >> (7 - bit_ % 8)) & 1 : 0;
+      value = (value << 1) | bit;
+    }
+    return value;
+  }
+
+  uint32_t get_unsigned() {
+    int bits = 0;
+    while (get(1) == 0 && ok() && bits < 32) {
+      ++bits;
+    }
+    uint64_t coded = 1;
+    for (int i = 0; i < bits; ++i) {
+      coded = (coded << 1) | get(1);
+    }
+    return uint32_t(coded - 1);
+  }
+
+  int32_t get_signed() {
+    const uint32_t value = get_unsigned();
+    return int32_t(value >> 1) ^ -int32_t(value & 1);
+  }
+
+private:
+  const uint8_t* bytes_;
+  size_t size_;
+  size_t bit_ = 0;
+};
+
+// where the ball would be after a tick of just carrying on, or riding along
+// on the paddle before a launch
+vec2 expected_ball(const rewind_frame_t& before, const int paddle_move) {
+  const bool preparing =
+    before.state_ == uint8_t(breakout_t::game_state_e::preparing);
+  return vec2{
+    before.ball_x_ + before.ball_velocity_x_ + (preparing ? paddle_move : 0),
+    before.ball_y_ + before.ball_velocity_y_};
+}
+
+// turns a game into a stream of frames for spectators, a keyframe with the
+// full state (the block rects too on a free-form level) every
+// keyframe_interval frames, whenever blocks come back and whenever the
+// layout changes, and in between bit packed deltas, which are usually a
+// single byte as the ball just carries on along its velocity
+class spectator_encoder_t {
+public:
+  explicit spectator_encoder_t(const int keyframe_interval)
+    : keyframe_interval_(keyframe_interval) {}
+
+  // make the next frame a keyframe
+  void force_keyframe() { since_keyframe_ = -1; }
+
+  // encodes the game as it is now, call once per step
+  spectator_frame_t encode(const breakout_t& game) {
+    const rewind_frame_t frame = game.frame();
+    const blocks_t& blocks = game.blocks();
+    const bool keyframe = since_keyframe_ < 0
+                       || since_keyframe_ + 1 >= keyframe_interval_
+                       || frame.blocks_remaining_ > previous_.blocks_remaining_
+                       || game.layout_version() != layout_version_;
+    layout_version_ = game.layout_version();
+    if (keyframe) {
+      encode_keyframe(frame, blocks);
+      since_keyframe_ = 0;
+    } else {
+      encode_delta(frame, blocks);
+      ++since_keyframe_;
+    }
+    previous_ = frame;
+    ++tick_;
+    return std::make_shared<const std::vector<uint8_t>>(writer_.take());
+  }
+
+private:
+  int keyframe_interval_;
+  int since_keyframe_ = -1;
+  uint32_t tick_ = 0;
+  uint32_t layout_version_ = 0;
+  int id_bits_ = 0;
+  rewind_frame_t previous_ = {};
+  int paddle_moves_[2] = {};
+  bit_writer_t writer_;
+
+  void encode_keyframe(const rewind_frame_t& frame, const blocks_t& blocks) {
+    const int block_count = int(blocks.block_ids_.size());
+    id_bits_ = 0;
+    while ((1 << id_bits_) < block_count) {
+      ++id_bits_;
+    }
+    paddle_moves_[0] = paddle_moves_[1] = 0;
+    writer_.put(1, 1);
+    writer_.put(tick_, 32);
+    writer_.put(uint16_t(frame.paddle_x_), 16);
+    writer_.put(uint16_t(frame.second_paddle_x_), 16);
+    writer_.put(uint16_t(frame.ball_x_), 16);
+    writer_.put(uint16_t(frame.ball_y_), 16);
+    writer_.put(uint32_t(frame.ball_velocity_x_ + 1), 2);
+    writer_.put(uint32_t(frame.ball_velocity_y_ + 1), 2);
+    writer_.put(frame.state_, 3);
+    writer_.put(frame.lives_, 8);
+    writer_.put(uint32_t(frame.score_), 32);
+    writer_.put(uint32_t(block_count), 32);
+    writer_.put(!blocks.rects_.empty(), 1);
+    for (const cell_rect_t& rect : blocks.rects_) {
+      writer_.put(uint16_t(rect.min_.x_), 16);
+      writer_.put(uint16_t(rect.min_.y_), 16);
+      writer_.put(uint16_t(rect.max_.x_), 16);
+      writer_.put(uint16_t(rect.max_.y_), 16);
+    }
+    std::vector<uint8_t> alive(block_count, 0);
+    for (int i = 0; i < blocks.remaining_; ++i) {
+      alive[blocks.block_ids_[i]] = 1;
+    }
+    for (const uint8_t bit : alive) {
+      writer_.put(bit, 1);
+    }
+  }
+
+  void encode_delta(const rewind_frame_t& frame, const blocks_t& blocks) {
+    const rewind_frame_t& before = previous_;
+    writer_.put(0, 1);
+
+    const int paddle_moves[] = {
+      frame.paddle_x_ - before.paddle_x_,
+      frame.second_paddle_x_ - before.second_paddle_x_};
+    for (int paddle = 0; paddle < 2; ++paddle) {
+      // a paddle tends to keep moving (or staying) the way it just did
+      const bool kept_moving = paddle_moves[paddle] == paddle_moves_[paddle];
+      writer_.put(kept_moving, 1);
+      if (!kept_moving) {
+        writer_.put_signed(paddle_moves[paddle]);
+        paddle_moves_[paddle] = paddle_moves[paddle];
+      }
+    }
+
+    const vec2 expected = expected_ball(before, paddle_moves[0]);
+    const bool carried_on =
+      frame.ball_x_ == expected.x_ && frame.ball_y_ == expected.y_;
+    writer_.put(carried_on, 1);
+    if (!carried_on) {
+      writer_.put_signed(frame.ball_x_ - expected.x_);
+      writer_.put_signed(frame.ball_y_ - expected.y_);
+    }
+    const bool turned = frame.ball_velocity_x_ != before.ball_velocity_x_
+                     || frame.ball_velocity_y_ != before.ball_velocity_y_;
+    writer_.put(turned, 1);
+    if (turned) {
+      writer_.put(uint32_t(frame.ball_velocity_x_ + 1), 2);
+      writer_.put(uint32_t(frame.ball_velocity_y_ + 1), 2);
+    }
+
+    const bool progressed = frame.state_ != before.state_
+                         || frame.lives_ != before.lives_
+                         || frame.score_ != before.score_;
+    writer_.put(progressed, 1);
+    if (progressed) {
+      writer_.put(frame.state_, 3);
+      writer_.put_signed(frame.lives_ - before.lives_);
+      writer_.put_signed(frame.score_ - before.score_);
+    }
+
+    // blocks destroyed since the last frame sit just past the live ones
+    const int destroyed = before.blocks_remaining_ - frame.blocks_remaining_;
+    writer_.put_unsigned(uint32_t(destroyed));
+    for (int i = destroyed - 1; i >= 0; --i) {
+      writer_.put(uint32_t(blocks.block_ids_[blocks.remaining_ + i]), id_bits_);
+    }
+  }
+};
+
+// the game as seen by a spectator, rebuilt from frames
+struct spectator_view_t {
+  bool synced_ = false; // a keyframe has been seen
+  uint32_t tick_ = 0;
+  rewind_frame_t frame_ = {};
+  std::vector<uint8_t> alive_; // per block id
+  std::vector<cell_rect_t> rects_; // per block id on a free-form level
+  int id_bits_ = 0;
+  int paddle_moves_[2] = {};
+
+  // applies the next frame in the stream, deltas are skipped until the
+  // first keyframe, false if the frame was skipped or malformed
+  bool apply(const std::vector<uint8_t>& bytes) {
+    bit_reader_t reader(bytes.data(), bytes.size());
+    if (reader.get(1) == 1) {
+      return apply_keyframe(reader);
+    }
+    if (!synced_) {
+      return false;
+    }
+    rewind_frame_t frame = frame_;
+    for (int paddle = 0; paddle < 2; ++paddle) {
+      if (reader.get(1) == 0) {
+        paddle_moves_[paddle] = reader.get_signed();
+      }
+    }
+    frame.paddle_x_ += paddle_moves_[0];
+    frame.second_paddle_x_ += paddle_moves_[1];
+    const vec2 expected = expected_ball(frame_, paddle_moves_[0]);
+    frame.ball_x_ = int16_t(expected.x_);
+    frame.ball_y_ = int16_t(expected.y_);
+    if (reader.get(1) == 0) {
+      frame.ball_x_ += reader.get_signed();
+      frame.ball_y_ += reader.get_signed();
+    }
+    if (reader.get(1) != 0) {
+      frame.ball_velocity_x_ = int8_t(int(reader.get(2)) - 1);
+      frame.ball_velocity_y_ = int8_t(int(reader.get(2)) - 1);
+    }
+    if (reader.get(1) != 0) {
+      frame.state_ = uint8_t(reader.get(3));
+      frame.lives_ = uint8_t(frame.lives_ + reader.get_signed());
+      frame.score_ += reader.get_signed();
+    }
+    const uint32_t destroyed = reader.get_unsigned();
+    for (uint32_t i = 0; i < destroyed && reader.ok(); ++i) {
+      const uint32_t id = reader.get(id_bits_);
+      if (id < alive_.size() && alive_[id] != 0) {
+        alive_[id] = 0;
+        frame.blocks_remaining_--;
+      }
+    }
+    if (!reader.ok()) {
+      synced_ = false; // wait for the next keyframe
+      return false;
+    }
+    frame_ = frame;
+    ++tick_;
+    return true;
+  }
+
+private:
+  bool apply_keyframe(bit_reader_t& reader) {
+    paddle_moves_[0] = paddle_moves_[1] = 0;
+    tick_ = reader.get(32);
+    frame_.paddle_x_ = int16_t(reader.get(16));
+    frame_.second_paddle_x_ = int16_t(reader.get(16));
+    frame_.ball_x_ = int16_t(reader.get(16));
+    frame_.ball_y_ = int16_t(reader.get(16));
+    frame_.ball_velocity_x_ = int8_t(int(reader.get(2)) - 1);
+    frame_.ball_velocity_y_ = int8_t(int(reader.get(2)) - 1);
+    frame_.state_ = uint8_t(reader.get(3));
+    frame_.lives_ = uint8_t(reader.get(8));
+    frame_.score_ = int32_t(reader.get(32));
+    const uint32_t block_count = reader.get(32);
+    const bool free_form = reader.get(1) != 0;
+    const uint64_t block_bits = uint64_t(block_count) * (free_form ? 65 : 1);
+    if (!reader.ok() || block_bits > reader.bits_left()) {
+      synced_ = false;
+      return false;
+    }
+    rects_.resize(free_form ? block_count : 0);
+    for (cell_rect_t& rect : rects_) {
+      rect.min_.x_ = int16_t(reader.get(16));
+      rect.min_.y_ = int16_t(reader.get(16));
+      rect.max_.x_ = int16_t(reader.get(16));
+      rect.max_.y_ = int16_t(reader.get(16));
+    }
+    alive_.resize(block_count);
+    frame_.blocks_remaining_ = 0;
+    for (uint8_t& alive : alive_) {
+      alive = uint8_t(reader.get(1));
+      frame_.blocks_remaining_ += alive;
+    }
+    id_bits_ = 0;
+    while ((uint32_t(1) << id_bits_) < block_count) {
+      ++id_bits_;
+    }
+    synced_ = reader.ok();
+    return synced_;
+  }
+};
+
+// fans frames out to every subscriber without copying them, holding on to
+// the frames since the last keyframe so late joiners can sync straight away
+class spectator_broadcast_t {
+public:
+  using queue_t = std::deque<spectator_frame_t>;
+
+  // a new subscriber, its queue primed with the last keyframe and the deltas
+  // since
+  int subscribe() {
+    int id = 0;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else {
+      id = int(queues_.size());
+      queues_.emplace_back();
+      subscribed_.push_back(0);
+    }
+    queues_[id] = queue_t(since_keyframe_.begin(), since_keyframe_.end());
+    subscribed_[id] = 1;
+    return id;
+  }
+
+  void unsubscribe(const int id) {
+    queues_[id].clear();
+    subscribed_[id] = 0;
+    free_ids_.push_back(id);
+  }
+
+  // stays valid until unsubscribe(), however many subscribe after
+  [[nodiscard]] queue_t& queue(const int id) { return queues_[id]; }
+
+  void publish(const spectator_frame_t& frame) {
+    if (((*frame)[0] & 0x80) != 0) { // keyframe bit
+      since_keyframe_.clear();
+    }
+    since_keyframe_.push_back(frame);
+    for (size_t id = 0; id < queues_.size(); ++id) {
+      if (subscribed_[id] != 0) {
+        queues_[id].push_back(frame);
+      }
+    }
+  }
+
+private:
+  std::deque<queue_t> queues_; // a deque so growing it moves no queue
+  std::vector<uint8_t> subscribed_;
+  std::vector<int> free_ids_;
+  std::vector<spectator_frame_t> since_keyframe_;
+};
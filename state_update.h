@@ -0,0 +1,146 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <cstdint>
+#include <vector>
+
+// what a client was last sent about a game, so the next update only needs to
+// carry what changed since (reset it whenever the game restarts)
+struct update_cursor_t {
+  int blocks_remaining_ = -1; // -1 until the first update
+};
+
+// a decoded state update
+struct state_update_t {
+  uint32_t tick_;
+  bool reset_; // destroyed_ lists every destroyed block, not just new ones
+  rewind_frame_t frame_;
+  std::vector<int> destroyed_; // block ids, most recently destroyed first
+};
+
+enum state_update_flags_e : uint8_t { state_update_reset = 1 };
+
+void put_varint(std::vector<uint8_t>& out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+// reads a varint, returning false if it runs past end
+bool get_varint(const uint8_t*& in, const uint8_t* end, uint32_t& value) {
+  value = 0;
+  for (int shift = 0; in != end && shift < 35; shift += 7) {
+    const uint8_t byte = *in++;
+    value |= uint32_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t zigzag(const int32_t value) {
+  return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+int32_t unzigzag(const uint32_t value) {
+  return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+// appends the game state as of tick to out, the blocks as the ids destroyed
+// since the cursor was taken (they sit in blocks_t::block_ids_ just past the
+// live ones) or every destroyed id if blocks came back or nothing was sent
+void encode_state_update(
+  const breakout_t& game, const uint32_t tick, const update_cursor_t& cursor,
+  std::vector<uint8_t>& out) {
+  const blocks_t& blocks = game.blocks();
+  const int remaining = blocks.remaining_;
+  const bool reset = cursor.blocks_remaining_ < 0
+                  || cursor.blocks_remaining_ < remaining;
+  const int destroyed =
+    reset ? int(blocks.block_ids_.size()) - remaining
+          : cursor.blocks_remaining_ - remaining;
+
+  const rewind_frame_t frame = game.frame();
+  put_varint(out, tick);
+  out.push_back(reset ? state_update_reset : 0);
+  put_varint(out, zigzag(frame.paddle_x_));
+  put_varint(out, zigzag(frame.second_paddle_x_));
+  put_varint(out, zigzag(frame.ball_x_));
+  put_varint(out, zigzag(frame.ball_y_));
+  // velocities are -1, 0 or 1 so share a byte with the state
+  out.push_back(static_cast<uint8_t>(
+    (frame.ball_velocity_x_ + 1) | ((frame.ball_velocity_y_ + 1) << 2)
+    | (frame.state_ << 4)));
+  out.push_back(frame.lives_);
+  put_varint(out, uint32_t(frame.score_));
+  put_varint(out, uint32_t(frame.blocks_remaining_));
+  put_varint(out, uint32_t(destroyed));
+  for (int i = 0; i < destroyed; ++i) {
+    put_varint(out, uint32_t(blocks.block_ids_[remaining + i]));
+  }
+}
+
+// decodes an update produced by encode_state_update, false if malformed
+bool decode_state_update(
+  const uint8_t* in, const uint8_t* end, state_update_t& update) {
+  uint32_t values[4];
+  if (!get_varint(in, end, update.tick_) || in == end) {
+    return false;
+  }
+  update.reset_ = (*in++ & state_update_reset) != 0;
+  for (uint32_t& value : values) {
+    if (!get_varint(in, end, value)) {
+      return false;
+    }
+  }
+  if (end - in < 2) {
+    return false;
+  }
+  const uint8_t motion = *in++;
+  rewind_frame_t& frame = update.frame_;
+  frame.paddle_x_ = static_cast<int16_t>(unzigzag(values[0]));
+  frame.second_paddle_x_ = static_cast<int16_t>(unzigzag(values[1]));
+  frame.ball_x_ = static_cast<int16_t>(unzigzag(values[2]));
+  frame.ball_y_ = static_cast<int16_t>(unzigzag(values[3]));
+  frame.ball_velocity_x_ = static_cast<int8_t>((motion & 3) - 1);
+  frame.ball_velocity_y_ = static_cast<int8_t>(((motion >> 2) & 3) - 1);
+  frame.state_ = static_cast<uint8_t>(motion >> 4);
+  frame.lives_ = *in++;
+
+  uint32_t score = 0;
+  uint32_t remaining = 0;
+  uint32_t destroyed = 0;
+  if (
+    !get_varint(in, end, score) || !get_varint(in, end, remaining)
+    || !get_varint(in, end, destroyed) || destroyed > uint32_t(end - in)) {
+    return false;
+  }
+  frame.score_ = int32_t(score);
+  frame.blocks_remaining_ = int32_t(remaining);
+  update.destroyed_.resize(destroyed);
+  for (int& id : update.destroyed_) {
+    uint32_t value = 0;
+    if (!get_varint(in, end, value)) {
+      return false;
+    }
+    id = int(value);
+  }
+  return in == end;
+}
+
+// brings a client side copy of the blocks (created the same way as the
+// server's) up to date with an update
+void apply_state_update(blocks_t& blocks, const state_update_t& update) {
+  if (update.reset_) {
+    reset_blocks(blocks);
+  }
+  // oldest first so the destroyed order matches the server's
+  for (auto id = update.destroyed_.rbegin(); id != update.destroyed_.rend();
+       ++id) {
+    destroy_block(blocks, *id % blocks.col_count, *id / blocks.col_count);
+  }
+}
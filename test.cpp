@@ -1,10 +1,29 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+#include "batch_runner.h"
 #include "breakout.h"
-
+#include "counter_rng.h"
+#include "glyph_table.h"
+#include "level_search.h"
+#include "lockstep.h"
+#include "packed_game.h"
+#include "rasterize.h"
+#include "render_layers.h"
+#include "session.h"
+#include "shared_state.h"
+#include "spectator.h"
+#include "state_update.h"
+#include "timer_wheel.h"
+#include "vector_env.h"
+
+#include <cstring>
+#include <deque>
 #include <numeric>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace doctest {
@@ -606,8 +625,395 @@ TEST_CASE("breakout game") {
 
     // first block was not drawn
     CHECK(
-      block_display_test.blocks_.front().begin_.x_
-      == blocks.col_margin + blocks.block_width + blocks.col_spacing);
+      block_display_test.blocks_.size()
+      == blocks.col_count * blocks.row_count - 1);
+    CHECK(std::none_of(
+      block_display_test.blocks_.begin(), block_display_test.blocks_.end(),
+      [&blocks](const auto& block) {
+        return block.begin_ == vec2{blocks.col_margin, blocks.row_margin};
+      }));
+  }
+
+  SUBCASE("alive blocks are kept densely packed") {
+    blocks_t blocks = create_blocks(breakout);
+
+    destroy_block(blocks, 0, 0);
+    destroy_block(blocks, 5, 3);
+
+    std::vector<int> alive;
+    for_each_live_block(blocks, [&](const int col, const int row) {
+      alive.push_back(block_id(blocks, col, row));
+    });
+    CHECK(alive.size() == blocks.col_count * blocks.row_count - 2);
+    CHECK(
+      std::find(alive.begin(), alive.end(), block_id(blocks, 0, 0))
+      == alive.end());
+    CHECK(
+      std::find(alive.begin(), alive.end(), block_id(blocks, 5, 3))
+      == alive.end());
+
+    // the reverse index stays in sync with the alive block ids
+    for (int index = 0; index < int(blocks.block_ids_.size()); ++index) {
+      CHECK(blocks.block_id_index_[blocks.block_ids_[index]] == index);
+    }
+
+    // destroyed blocks follow the alive ones, most recent first
+    CHECK(blocks.block_ids_[blocks.remaining_] == block_id(blocks, 5, 3));
+    CHECK(blocks.block_ids_[blocks.remaining_ + 1] == block_id(blocks, 0, 0));
+  }
+
+  SUBCASE("remaining block count decreases as blocks are destroyed") {
+    blocks_t blocks = create_blocks(breakout);
+    const int block_count = breakout.block_cols() * breakout.block_rows();
+    CHECK(blocks_remaining(blocks) == block_count);
+
+    destroy_block(blocks, 3, 4);
+    CHECK(blocks_remaining(blocks) == block_count - 1);
+
+    // destroying an already destroyed block has no effect
+    destroy_block(blocks, 3, 4);
+    CHECK(blocks_remaining(blocks) == block_count - 1);
+  }
+
+  SUBCASE("cleared rows are removed from the row summary") {
+    blocks_t blocks = create_blocks(breakout);
+    CHECK(blocks.row_counts_[2] == blocks.col_count);
+    CHECK((blocks.live_rows_[0] & (uint64_t(1) << 2)) != 0);
+
+    for (int col = 0; col < blocks.col_count; ++col) {
+      destroy_block(blocks, col, 2);
+    }
+    CHECK(blocks.row_counts_[2] == 0);
+    CHECK((blocks.live_rows_[0] & (uint64_t(1) << 2)) == 0);
+
+    std::vector<int> live_rows;
+    find_live_row(blocks, [&live_rows](const int row) {
+      live_rows.push_back(row);
+      return false;
+    });
+    CHECK(live_rows.size() == blocks.row_count - 1);
+    CHECK(std::find(live_rows.begin(), live_rows.end(), 2) == live_rows.end());
+
+    ball_t ball;
+    ball.position_ = block_position(blocks, 4, 2).value();
+    CHECK(!intersects(blocks, ball));
+  }
+
+  SUBCASE("cell map lookup matches block scan") {
+    // no spacing makes neighbouring blocks overlap by a cell
+    for (const int col_spacing : {1, 0}) {
+      blocks_t scanned = create_blocks(breakout);
+      scanned.col_spacing = col_spacing;
+      blocks_t mapped = scanned;
+      const vec2 map_size = {
+        breakout.board_size().x_ + 1, breakout.board_size().y_ + 1};
+      build_cell_map(mapped, map_size, cell_map_width_e::int16);
+
+      for (const auto [col, row] : {vec2{0, 0}, vec2{4, 2}, vec2{10, 8}}) {
+        destroy_block(scanned, col, row);
+        destroy_block(mapped, col, row);
+      }
+
+      int mismatches = 0;
+      for (int y = 0; y < map_size.y_; ++y) {
+        for (int x = 0; x < map_size.x_; ++x) {
+          ball_t ball;
+          ball.position_ = {x, y};
+          const auto scanned_lookup = intersects(scanned, ball);
+          const auto mapped_lookup = intersects(mapped, ball);
+          if (
+            scanned_lookup.has_value() != mapped_lookup.has_value()
+            || (scanned_lookup
+                && (scanned_lookup->col_ != mapped_lookup->col_
+                    || scanned_lookup->row_ != mapped_lookup->row_))) {
+            mismatches++;
+          }
+        }
+      }
+      CHECK(mismatches == 0);
+    }
+  }
+
+  SUBCASE("cell map memory depends on id width") {
+    blocks_t blocks = create_blocks(breakout);
+    const vec2 map_size = {100, 50};
+    const size_t rect_bytes =
+      blocks.col_count * blocks.row_count * sizeof(cell_rect_t);
+
+    CHECK(cell_map_bytes(blocks.cell_map_) == 0);
+    build_cell_map(blocks, map_size, cell_map_width_e::int16);
+    CHECK(cell_map_bytes(blocks.cell_map_) == 100 * 50 * 2 + rect_bytes);
+    build_cell_map(blocks, map_size, cell_map_width_e::int32);
+    CHECK(cell_map_bytes(blocks.cell_map_) == 100 * 50 * 4 + rect_bytes);
+  }
+
+  SUBCASE("irregular block cells can be hit and are cleared when destroyed") {
+    blocks_t blocks = create_blocks(breakout);
+    build_cell_map(blocks, vec2{101, 31}, cell_map_width_e::int32);
+
+    // make a tall block hanging below the grid
+    set_block_cells(blocks, 3, 0, cell_rect_t{vec2{40, 20}, vec2{42, 25}});
+
+    ball_t ball;
+    ball.position_ = {41, 23};
+    const auto lookup = intersects(blocks, ball);
+    CHECK(lookup.has_value());
+    CHECK(lookup->col_ == 3);
+    CHECK(lookup->row_ == 0);
+
+    // its original cells no longer belong to it
+    ball.position_ = block_position(blocks, 3, 0).value();
+    CHECK(!intersects(blocks, ball));
+
+    destroy_block(blocks, 3, 0);
+    ball.position_ = {41, 23};
+    CHECK(!intersects(blocks, ball));
+  }
+
+  SUBCASE("destroying a block hands its cells to a block moved over it") {
+    blocks_t blocks = create_blocks(breakout);
+    build_cell_map(blocks, vec2{101, 31}, cell_map_width_e::int32);
+
+    set_block_cells(blocks, 0, 1, block_cell_rect(blocks, 5, 0));
+    destroy_block(blocks, 5, 0);
+
+    ball_t ball;
+    ball.position_ = block_position(blocks, 5, 0).value();
+    CHECK(
+      cell_map_block(blocks.cell_map_, ball.position_)
+      == block_id(blocks, 0, 1));
+    const auto lookup = intersects(blocks, ball);
+    REQUIRE(lookup.has_value());
+    CHECK(lookup->col_ == 0);
+    CHECK(lookup->row_ == 1);
+  }
+
+  SUBCASE("destroying moved blocks leaves the map a repaint gives") {
+    blocks_t blocks = create_blocks(breakout);
+    build_cell_map(blocks, vec2{101, 31}, cell_map_width_e::int16);
+    // a row of blocks moved into overlapping rects, a few off the board
+    for (int col = 0; col < blocks.col_count; ++col) {
+      const vec2 min = {col * 9 % 95 - 4, 16 + col % 4};
+      set_block_cells(
+        blocks, col, 1, cell_rect_t{min, vec2{min.x_ + 14, min.y_ + 2}});
+    }
+    for (int col = 0; col < blocks.col_count; col += 3) {
+      destroy_block(blocks, col, 1);
+      destroy_block(blocks, col, 0);
+    }
+    blocks_t repainted = blocks;
+    repaint_cell_map(repainted);
+    CHECK(blocks.cell_map_.cells16_ == repainted.cell_map_.cells16_);
+  }
+
+  SUBCASE("a moved block is drawn where it can be hit") {
+    blocks_t blocks = create_blocks(breakout);
+    build_cell_map(blocks, vec2{101, 31}, cell_map_width_e::int16);
+    const cell_rect_t rect = {vec2{40, 20}, vec2{42, 21}};
+    set_block_cells(blocks, 3, 0, rect);
+    struct cells_t {
+      std::vector<vec2> cells_;
+      void output(const int x, const int y, char) { cells_.push_back({x, y}); }
+    } drawn;
+    display_blocks(blocks, vec2{0, 0}, drawn, '#');
+    const auto count = std::count_if(
+      drawn.cells_.begin(), drawn.cells_.end(),
+      [&rect](const vec2 cell) { return contains(rect, cell); });
+    CHECK(count == 6);
+    CHECK(
+      int(drawn.cells_.size())
+      == (blocks_remaining(blocks) - 1) * blocks.block_width + 6);
+  }
+
+  SUBCASE("breakout builds a cell map on restart when enabled") {
+    breakout.set_cell_map_width(cell_map_width_e::int16);
+    breakout.restart();
+    CHECK(breakout.blocks().cell_map_.width_ == cell_map_width_e::int16);
+    CHECK(
+      breakout.blocks().cell_map_.size_
+      == vec2{breakout.board_size().x_ + 1, breakout.board_size().y_ + 1});
+  }
+
+  SUBCASE("free-form blocks are found through the bvh") {
+    // a field of blocks with varying sizes, some overlapping
+    std::vector<cell_rect_t> rects;
+    for (int i = 0; i < 200; ++i) {
+      const int x = (i * 37) % 90 + 1;
+      const int y = (i * 11) % 25 + 1;
+      rects.push_back(cell_rect_t{vec2{x, y}, vec2{x + i % 7, y + i % 3}});
+    }
+    blocks_t blocks = create_free_form_blocks(rects);
+    CHECK(blocks.bvh_.nodes_.front().alive_ == 200);
+
+    for (int id = 0; id < 200; id += 3) {
+      destroy_block(blocks, id, 0);
+    }
+    CHECK(blocks.bvh_.nodes_.front().alive_ == blocks_remaining(blocks));
+
+    int mismatches = 0;
+    for (int y = 0; y < 30; ++y) {
+      for (int x = 0; x < 100; ++x) {
+        int expected = -1;
+        for (int id = 0; id < 200 && expected == -1; ++id) {
+          if (!block_destroyed(blocks, id, 0) && contains(rects[id], {x, y})) {
+            expected = id;
+          }
+        }
+        ball_t ball;
+        ball.position_ = {x, y};
+        const auto lookup = intersects(blocks, ball);
+        if ((lookup ? lookup->col_ : -1) != expected) {
+          mismatches++;
+        }
+      }
+    }
+    CHECK(mismatches == 0);
+  }
+
+  SUBCASE("cleared bvh subtrees are pruned") {
+    blocks_t blocks = create_free_form_blocks(
+      {cell_rect_t{vec2{1, 1}, vec2{4, 2}},
+       cell_rect_t{vec2{10, 1}, vec2{12, 1}},
+       cell_rect_t{vec2{20, 5}, vec2{29, 9}},
+       cell_rect_t{vec2{40, 1}, vec2{41, 1}},
+       cell_rect_t{vec2{50, 3}, vec2{52, 3}},
+       cell_rect_t{vec2{60, 8}, vec2{61, 9}}});
+    for (int id = 0; id < blocks.col_count; ++id) {
+      destroy_block(blocks, id, 0);
+    }
+    for (const auto& node : blocks.bvh_.nodes_) {
+      CHECK(node.alive_ == 0);
+    }
+    ball_t ball;
+    ball.position_ = {25, 7};
+    CHECK(!intersects(blocks, ball));
+  }
+
+  SUBCASE("free-form blocks are displayed using their rects") {
+    const blocks_t blocks = create_free_form_blocks(
+      {cell_rect_t{vec2{1, 1}, vec2{4, 2}},
+       cell_rect_t{vec2{10, 3}, vec2{10, 5}}});
+    display_test_t display_test;
+    display_blocks(blocks, vec2{0, 0}, display_test, std::string_view{"*"});
+    CHECK(display_test.positions_.size() == 4 * 2 + 3);
+  }
+
+  SUBCASE("row kernels agree with the scalar kernel") {
+    std::vector<row_hit_mask_fn_t> kernels = {row_kernel().hit_mask_};
+#ifdef BREAKOUT_ROW_KERNEL_X86
+    kernels.push_back(row_hit_mask_sse2);
+    if (cpu_supports_avx2()) {
+      kernels.push_back(row_hit_mask_avx2);
+    }
+#endif
+    int mismatches = 0;
+    for (const auto& row :
+         {row_extents_t{2, 9, 8, 11}, row_extents_t{2, 8, 8, 64},
+          row_extents_t{-30, 3, 1, 37}, row_extents_t{5, 1, 0, 5}}) {
+      for (int x = -40; x < 600; ++x) {
+        const uint64_t expected = row_hit_mask_scalar(row, x);
+        for (const auto kernel : kernels) {
+          mismatches += kernel(row, x) != expected ? 1 : 0;
+        }
+      }
+    }
+    CHECK(mismatches == 0);
+  }
+
+  SUBCASE("batch row kernels agree with the scalar kernel") {
+    std::vector<row_hit_masks_fn_t> kernels = {row_kernel().hit_masks_};
+#ifdef BREAKOUT_ROW_KERNEL_X86
+    kernels.push_back(row_hit_masks_sse2);
+    if (cpu_supports_avx2()) {
+      kernels.push_back(row_hit_masks_avx2);
+    }
+#endif
+    // a count that leaves balls over after the last full vector
+    std::vector<int> xs;
+    for (int x = -40; x < 600; x += 3) {
+      xs.push_back(x);
+    }
+    std::vector<uint64_t> masks(xs.size());
+    int mismatches = 0;
+    for (const auto& row :
+         {row_extents_t{2, 9, 8, 11}, row_extents_t{2, 8, 8, 64},
+          row_extents_t{-30, 3, 1, 37}, row_extents_t{5, 1, 0, 5}}) {
+      for (const auto kernel : kernels) {
+        kernel(row, xs.data(), int(xs.size()), masks.data());
+        for (size_t i = 0; i < xs.size(); ++i) {
+          mismatches += masks[i] != row_hit_mask_scalar(row, xs[i]) ? 1 : 0;
+        }
+      }
+    }
+    CHECK(xs.size() % 8 != 0);
+    CHECK(mismatches == 0);
+  }
+
+  SUBCASE("many balls can be tested against the blocks at once") {
+    blocks_t blocks = create_blocks(breakout);
+    blocks.col_count = 150;
+    reset_blocks(blocks);
+    destroy_block(blocks, 0, 0);
+    destroy_block(blocks, 70, 3);
+
+    std::vector<ball_t> balls;
+    for (int y = 0; y < 20; ++y) {
+      for (int x = 0; x < 1400; x += 3) {
+        balls.push_back(ball_t{vec2{x, y}, vec2{1, 1}});
+      }
+    }
+    std::vector<std::optional<lookup_t>> lookups(balls.size());
+    intersects(blocks, balls.data(), int(balls.size()), lookups.data());
+
+    int mismatches = 0;
+    for (size_t i = 0; i < balls.size(); ++i) {
+      const auto lookup = intersects(blocks, balls[i]);
+      if (
+        lookup.has_value() != lookups[i].has_value()
+        || (lookup
+            && (lookup->col_ != lookups[i]->col_
+                || lookup->row_ != lookups[i]->row_))) {
+        mismatches++;
+      }
+    }
+    CHECK(mismatches == 0);
+    CHECK(std::count_if(lookups.begin(), lookups.end(), [](const auto& l) {
+            return l.has_value();
+          }) > 0);
+  }
+
+  SUBCASE("large boards are stored in chunks") {
+    blocks_t blocks = create_blocks(breakout);
+    blocks.col_count = 1000;
+    blocks.row_count = 3;
+    reset_blocks(blocks);
+
+    const int chunks_per_row =
+      (blocks.col_count + block_chunk_size - 1) / block_chunk_size;
+    CHECK(int(blocks.chunks_.size()) == chunks_per_row * blocks.row_count);
+    CHECK(blocks.chunks_.back().count_ == blocks.col_count % block_chunk_size);
+
+    // clear everything apart from a single block near the end of a row
+    for (int row = 0; row < blocks.row_count; ++row) {
+      for (int col = 0; col < blocks.col_count; ++col) {
+        if (row != 1 || col != 900) {
+          destroy_block(blocks, col, row);
+        }
+      }
+    }
+    CHECK(blocks_remaining(blocks) == 1);
+
+    display_block_test_t block_display_test(blocks.block_width);
+    display_blocks(
+      blocks, vec2{0, 0}, block_display_test, std::string_view{"*"});
+    CHECK(block_display_test.blocks_.size() == 1);
+
+    ball_t ball;
+    ball.position_ = block_position(blocks, 900, 1).value();
+    const auto lookup = intersects(blocks, ball);
+    CHECK(lookup.has_value());
+    CHECK(lookup->col_ == 900);
+    CHECK(lookup->row_ == 1);
   }
 
   SUBCASE("score increases after block is destroyed") {
@@ -630,6 +1036,121 @@ TEST_CASE("breakout game") {
     CHECK(breakout.block_score() * hit_count == breakout.score());
   }
 
+  SUBCASE("landing point prediction matches simulation") {
+    breakout.set_block_bounce_fn([](blocks_t&, ball_t&) { return false; });
+    int mismatches = 0;
+    for (int offset = -40; offset <= 40; offset += 7) {
+      for (const bool left : {true, false}) {
+        breakout.restart();
+        if (offset < 0) {
+          breakout.move_paddle_left(-offset);
+        } else {
+          breakout.move_paddle_right(offset);
+        }
+        left ? breakout.launch_left() : breakout.launch_right();
+        const int paddle_y = breakout.paddle_position().y_;
+        // predict from every tick of the flight up and back down
+        std::vector<int> predictions;
+        do {
+          predictions.push_back(predict_landing_x(breakout).value_or(-1));
+          breakout.step();
+        } while (breakout.ball_position().y_ != paddle_y);
+        for (const int prediction : predictions) {
+          mismatches += prediction != breakout.ball_position().x_ ? 1 : 0;
+        }
+      }
+    }
+    CHECK(mismatches == 0);
+  }
+
+  SUBCASE("autopilot keeps the ball in play") {
+    for (int tick = 0; tick < 20000; ++tick) {
+      autopilot(breakout, breakout.board_size().x_);
+      breakout.step();
+      if (breakout.state() == breakout_t::game_state_e::game_complete) {
+        break;
+      }
+    }
+    CHECK(breakout.lives() == breakout.starting_lives());
+    CHECK(breakout.score() > 0);
+  }
+
+  SUBCASE("a destroyed block can be restored") {
+    blocks_t blocks = create_blocks(breakout);
+    build_cell_map(blocks, vec2{101, 31}, cell_map_width_e::int16);
+    const int block_count = blocks_remaining(blocks);
+
+    for (int col = 0; col < blocks.col_count; ++col) {
+      destroy_block(blocks, col, 4);
+    }
+    restore_block(blocks, 6, 4);
+    CHECK(!block_destroyed(blocks, 6, 4));
+    CHECK(blocks_remaining(blocks) == block_count - blocks.col_count + 1);
+    CHECK(blocks.row_counts_[4] == 1);
+    CHECK((blocks.live_rows_[0] & (uint64_t(1) << 4)) != 0);
+
+    ball_t ball;
+    ball.position_ = block_position(blocks, 6, 4).value();
+    CHECK(intersects(blocks, ball).has_value());
+
+    // restoring the rest brings back the most recently destroyed first
+    restore_blocks(blocks, block_count - 1);
+    CHECK(block_destroyed(blocks, 0, 4));
+    CHECK(!block_destroyed(blocks, 1, 4));
+  }
+
+  SUBCASE("rewind returns to the state of an earlier tick") {
+    breakout.enable_rewind(100);
+    breakout.launch_right();
+
+    struct state_t {
+      vec2 ball_position_;
+      vec2 ball_velocity_;
+      int score_;
+      int blocks_remaining_;
+    };
+    std::vector<state_t> states;
+    for (int tick = 0; tick < 90; ++tick) {
+      breakout.step();
+      states.push_back(state_t{
+        breakout.ball_position(), breakout.ball_velocity(), breakout.score(),
+        breakout.blocks_remaining()});
+    }
+    REQUIRE(breakout.score() > 0);
+
+    CHECK(breakout.rewind(60) == 60);
+    const auto& before = states[90 - 1 - 60];
+    CHECK(breakout.ball_position() == before.ball_position_);
+    CHECK(breakout.ball_velocity() == before.ball_velocity_);
+    CHECK(breakout.score() == before.score_);
+    CHECK(breakout.blocks_remaining() == before.blocks_remaining_);
+
+    // playing forward again repeats exactly what happened before
+    for (int tick = 90 - 60; tick < 90; ++tick) {
+      breakout.step();
+      CHECK(breakout.ball_position() == states[tick].ball_position_);
+      CHECK(breakout.score() == states[tick].score_);
+    }
+  }
+
+  SUBCASE("rewind is limited to the recorded ticks") {
+    breakout.enable_rewind(10);
+    breakout.launch_left();
+    for (int tick = 0; tick < 4; ++tick) {
+      breakout.step();
+    }
+    CHECK(breakout.rewind_available() == 4);
+    // the oldest frame was recorded before the ball was launched
+    CHECK(breakout.rewind(100) == 4);
+    CHECK(breakout.state() == breakout_t::game_state_e::preparing);
+    CHECK(breakout.ball_position().y_ == breakout.paddle_position().y_ - 1);
+
+    for (int tick = 0; tick < 30; ++tick) {
+      breakout.step();
+    }
+    CHECK(breakout.rewind_available() == 10);
+  }
+
   auto simulate_game_over = [](breakout_t& breakout) {
     while (true) {
       if (breakout.lives() == 0) {
@@ -645,6 +1166,310 @@ TEST_CASE("breakout game") {
     }
   };
 
+  SUBCASE("step reports what happened as events") {
+    uint64_t cursor = breakout.events().written();
+    int destroyed = 0;
+    int paddle_hits = 0;
+    int lives_lost = 0;
+    int game_overs = 0;
+    bool blocks_match = true;
+    // play badly enough to lose every life after a while
+    for (int tick = 0;
+         breakout.state() != breakout_t::game_state_e::game_over; ++tick) {
+      if (tick % 300 < 200) {
+        autopilot(breakout, 2);
+      } else {
+        breakout.launch_left();
+      }
+      breakout.step();
+      const uint64_t missed =
+        breakout.events().drain(cursor, [&](const game_event_t& event) {
+          switch (event.type_) {
+            case game_event_e::block_destroyed:
+              ++destroyed;
+              blocks_match = blocks_match
+                          && block_destroyed(
+                               breakout.blocks(), event.col_, event.row_);
+              break;
+            case game_event_e::paddle_hit:
+              ++paddle_hits;
+              break;
+            case game_event_e::life_lost:
+              ++lives_lost;
+              break;
+            case game_event_e::game_over:
+              ++game_overs;
+              break;
+            default:
+              break;
+          }
+        });
+      CHECK(missed == 0);
+    }
+    CHECK(blocks_match);
+    CHECK(destroyed * breakout.block_score() == breakout.score());
+    CHECK(
+      destroyed
+      == breakout.block_cols() * breakout.block_rows()
+           - breakout.blocks_remaining());
+    CHECK(paddle_hits > 0);
+    CHECK(lives_lost == breakout.starting_lives());
+    CHECK(game_overs == 1);
+    CHECK(cursor == breakout.events().written());
+  }
+
+  SUBCASE("a consumer too far behind skips to the oldest event kept") {
+    uint64_t cursor = breakout.events().written();
+    for (int tick = 0; tick < 2000; ++tick) {
+      autopilot(breakout, 2);
+      breakout.step();
+    }
+    const uint64_t pending = breakout.events().written() - cursor;
+    REQUIRE(pending > uint64_t(game_event_capacity));
+    int seen = 0;
+    CHECK(
+      breakout.events().drain(cursor, [&seen](const auto&) { ++seen; })
+      == pending - game_event_capacity);
+    CHECK(seen == game_event_capacity);
+  }
+
+  SUBCASE("random launches depend only on the seed and tick") {
+    std::vector<uint8_t> log;
+    breakout.set_input_log(&log);
+    std::vector<int> directions;
+    for (int seed = 0; seed < 64; ++seed) {
+      breakout.set_seed(uint64_t(seed));
+      breakout.restart();
+      for (int tick = 0; tick < seed % 5; ++tick) {
+        breakout.step();
+      }
+      CHECK(breakout.tick() == seed % 5);
+      breakout.launch_random();
+      directions.push_back(breakout.ball_velocity().x_);
+    }
+    CHECK(std::count(directions.begin(), directions.end(), -1) > 16);
+    CHECK(std::count(directions.begin(), directions.end(), 1) > 16);
+
+    // the log holds the directions taken, so replaying needs no seed
+    breakout_t replayed;
+    replayed.setup(test_x, test_y, test_width, test_height);
+    std::vector<int> replayed_directions;
+    for (size_t offset = 0; offset < log.size();) {
+      const auto op = static_cast<input_op_e>(log[offset]);
+      offset = replay_input(replayed, log, offset);
+      if (op == input_op_e::launch_left || op == input_op_e::launch_right) {
+        replayed_directions.push_back(replayed.ball_velocity().x_);
+      }
+    }
+    CHECK(replayed_directions == directions);
+  }
+
+  SUBCASE("rewinding winds the tick back") {
+    breakout.enable_rewind(10);
+    breakout.launch_right();
+    for (int tick = 0; tick < 8; ++tick) {
+      breakout.step();
+    }
+    CHECK(breakout.rewind(5) == 5);
+    CHECK(breakout.tick() == 3);
+    breakout.restart();
+    CHECK(breakout.tick() == 0);
+  }
+
+  SUBCASE("random levels are generated from the seed") {
+    const auto level = [&breakout](const uint64_t seed, const int fill) {
+      breakout.set_seed(seed);
+      breakout.set_create_blocks_fn([fill](const breakout_t& breakout) {
+        return create_random_blocks(breakout, fill);
+      });
+      breakout.restart();
+      return breakout.blocks().rects_;
+    };
+    const auto same_rects = [](const auto& lhs, const auto& rhs) {
+      return std::equal(
+        lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+        [](const cell_rect_t& a, const cell_rect_t& b) {
+          return a.min_ == b.min_ && a.max_ == b.max_;
+        });
+    };
+
+    const auto half = level(7, 500);
+    const int total = breakout.block_cols() * breakout.block_rows();
+    CHECK(int(half.size()) > total / 4);
+    CHECK(int(half.size()) < total * 3 / 4);
+    CHECK(same_rects(level(7, 500), half));
+    CHECK(!same_rects(level(8, 500), half));
+    CHECK(int(level(7, 1000).size()) == total);
+    CHECK(level(7, 0).size() == 1);
+
+    // every block kept is drawn where it would be in the standard layout
+    const blocks_t grid = ::create_blocks(breakout);
+    for (const cell_rect_t& rect : half) {
+      CHECK(std::any_of(
+        grid.block_ids_.begin(), grid.block_ids_.end(), [&](const int id) {
+          const cell_rect_t cell = block_drawn_rect(
+            grid, id % grid.col_count, id / grid.col_count);
+          return cell.min_ == rect.min_ && cell.max_ == rect.max_;
+        }));
+    }
+
+    // so a full level looks just like the grid, gaps between blocks included
+    level(7, 1000);
+    const vec2 size = raster_size(breakout, 1);
+    std::vector<uint8_t> full(size.x_ * size.y_);
+    rasterize(breakout, full.data());
+    breakout.set_layout_blocks_fn(layout_blocks);
+    breakout.restart();
+    std::vector<uint8_t> standard(size.x_ * size.y_);
+    rasterize(breakout, standard.data());
+    CHECK(full == standard);
+  }
+
+  SUBCASE("restarts reuse the block storage") {
+    const auto storage = [&breakout] {
+      const blocks_t& blocks = breakout.blocks();
+      return std::vector<const void*>{
+        blocks.chunks_.data(), blocks.row_counts_.data(),
+        blocks.live_rows_.data(), blocks.block_ids_.data(),
+        blocks.block_id_index_.data()};
+    };
+    breakout.launch_left();
+    while (breakout.blocks_remaining() == 99) {
+      breakout.step();
+    }
+    breakout.restart();
+    const auto first = storage();
+    breakout.restart();
+    const auto second = storage();
+    CHECK(first != second);
+    for (int i = 0; i < 4; ++i) {
+      breakout.launch_right();
+      for (int tick = 0; tick < 200; ++tick) {
+        autopilot(breakout, 2);
+        breakout.step();
+      }
+      breakout.restart();
+      CHECK(storage() == (i % 2 == 0 ? first : second));
+      CHECK(breakout.blocks_remaining() == 99);
+      CHECK(same_block_layout(breakout.blocks(), ::create_blocks(breakout)));
+    }
+  }
+
+  SUBCASE("levels laid out in reused storage match new ones") {
+    breakout.set_layout_blocks_fn(
+      [](const breakout_t& breakout, blocks_t& blocks) {
+        layout_random_blocks(breakout, 600, blocks);
+      });
+    breakout.set_cell_map_width(cell_map_width_e::int16);
+    for (uint64_t seed = 0; seed < 6; ++seed) {
+      breakout.set_seed(seed % 4);
+      breakout.restart();
+      const blocks_t& blocks = breakout.blocks();
+      const blocks_t expected = create_random_blocks(breakout, 600);
+      CHECK(same_block_layout(blocks, expected));
+      CHECK(blocks.bvh_.nodes_.size() == expected.bvh_.nodes_.size());
+      CHECK(blocks.cell_map_.width_ == cell_map_width_e::int16);
+      CHECK(blocks.cell_map_.rects_.size() == expected.rects_.size());
+      int mismatches = 0;
+      for (int y = 0; y < test_height; ++y) {
+        for (int x = 0; x < test_width; ++x) {
+          const int id = find_block_bvh(expected, vec2{x, y});
+          mismatches += find_block_bvh(blocks, vec2{x, y}) != id;
+          mismatches += cell_map_block(blocks.cell_map_, vec2{x, y}) != id;
+        }
+      }
+      CHECK(mismatches == 0);
+    }
+
+    // a cell map of other settings is dropped rather than reused
+    breakout.set_cell_map_width(cell_map_width_e::none);
+    breakout.restart();
+    breakout.restart();
+    CHECK(breakout.blocks().cell_map_.width_ == cell_map_width_e::none);
+  }
+
+  SUBCASE("step_n plays out as repeated step() does") {
+    // the grid with some blocks moved off it, one to a bar below the others
+    const auto moved_layout = [](const breakout_t& breakout, blocks_t& blocks) {
+      layout_blocks(breakout, blocks);
+      const auto [width, height] = breakout.board_size();
+      if (blocks.cell_map_.width_ == cell_map_width_e::none) {
+        build_cell_map(
+          blocks, vec2{width + 1, height + 1}, cell_map_width_e::int16);
+      }
+      set_block_cells(blocks, 0, 0, cell_rect_t{vec2{1, 22}, vec2{40, 22}});
+      set_block_cells(blocks, 5, 1, cell_rect_t{vec2{60, 16}, vec2{64, 18}});
+      set_block_cells(blocks, 9, 2, block_cell_rect(blocks, 3, 0));
+    };
+    const auto setup = [&](breakout_t& breakout, const bool moved) {
+      breakout.setup(test_x, test_y, test_width, test_height);
+      if (moved) {
+        breakout.set_cell_map_width(cell_map_width_e::int16);
+        breakout.set_layout_blocks_fn(moved_layout);
+        breakout.restart();
+      }
+    };
+    for (const auto& [slots, moved] :
+         {std::pair{0, false}, std::pair{1024, false}, std::pair{0, true},
+          std::pair{1024, true}}) {
+      breakout_t bulk;
+      setup(bulk, moved);
+      bulk.enable_trajectory_cache(slots);
+      std::vector<uint8_t> log;
+      bulk.set_input_log(&log);
+      int reasons[3] = {};
+      for (int ticks = 0; ticks < 20000;) {
+        if (bulk.state() == breakout_t::game_state_e::game_over) {
+          bulk.restart();
+        }
+        autopilot(bulk, 100);
+        const auto state = bulk.state();
+        const int blocks = bulk.blocks_remaining();
+        const auto result = bulk.step_n(500);
+        ticks += result.ticks_;
+        reasons[int(result.reason_)]++;
+        switch (result.reason_) {
+          case breakout_t::step_stop_e::count:
+            CHECK(result.ticks_ == 500);
+            CHECK(bulk.blocks_remaining() == blocks);
+            break;
+          case breakout_t::step_stop_e::state_changed:
+            CHECK(bulk.state() != state);
+            break;
+          case breakout_t::step_stop_e::block_destroyed:
+            CHECK(bulk.state() == state);
+            CHECK(bulk.blocks_remaining() < blocks);
+            break;
+        }
+      }
+      CHECK(reasons[int(breakout_t::step_stop_e::state_changed)] > 0);
+      CHECK(reasons[int(breakout_t::step_stop_e::block_destroyed)] > 0);
+
+      breakout_t stepped;
+      setup(stepped, moved);
+      for (size_t offset = 0; offset < log.size();) {
+        offset = replay_input(stepped, log, offset);
+      }
+      CHECK(stepped.tick() == bulk.tick());
+      CHECK(stepped.ball_position() == bulk.ball_position());
+      CHECK(stepped.ball_velocity() == bulk.ball_velocity());
+      CHECK(stepped.paddle_position() == bulk.paddle_position());
+      CHECK(stepped.score() == bulk.score());
+      CHECK(stepped.lives() == bulk.lives());
+      CHECK(stepped.state() == bulk.state());
+      CHECK(stepped.blocks().block_ids_ == bulk.blocks().block_ids_);
+    }
+  }
+
+  SUBCASE("step_n waits out the ticks before a launch") {
+    const auto result = breakout.step_n(10);
+    CHECK(result.ticks_ == 10);
+    CHECK(result.reason_ == breakout_t::step_stop_e::count);
+    CHECK(breakout.tick() == 10);
+    CHECK(breakout.state() == breakout_t::game_state_e::preparing);
+    CHECK(breakout.step_n(0).ticks_ == 0);
+  }
+
   SUBCASE("zero lives results in game over") {
     simulate_game_over(breakout);
     CHECK(breakout.state() == breakout_t::game_state_e::game_over);
@@ -676,9 +1501,11 @@ TEST_CASE("breakout game") {
   SUBCASE("all blocks destroyed wins game") {
     const auto create_blocks_destroyed = [](const breakout_t& breakout) {
       auto blocks = ::create_blocks(breakout);
-      std::for_each(
-        std::begin(blocks.destroyed_), std::end(blocks.destroyed_),
-        [](auto& block) { block = true; });
+      for (int row = 0; row < blocks.row_count; ++row) {
+        for (int col = 0; col < blocks.col_count; ++col) {
+          destroy_block(blocks, col, row);
+        }
+      }
       return blocks;
     };
 
@@ -691,3 +1518,1393 @@ TEST_CASE("breakout game") {
     CHECK(breakout.state() == breakout_t::game_state_e::game_complete);
   }
 }
+
+TEST_CASE("counter rng") {
+  const counter_rng_t rng(42, rng_stream_e::launch);
+
+  SUBCASE("draws are a function of the seed, stream and counter") {
+    CHECK(rng.draw(5, 1) == counter_rng_t(42, rng_stream_e::launch).draw(5, 1));
+    CHECK(rng.draw(5, 1) != rng.draw(5, 2));
+    CHECK(rng.draw(5, 1) != rng.draw(6, 1));
+    CHECK(rng.draw(5, 1) != counter_rng_t(43, rng_stream_e::launch).draw(5, 1));
+    CHECK(rng.draw(5, 1) != counter_rng_t(42, rng_stream_e::blocks).draw(5, 1));
+  }
+
+  SUBCASE("bounded draws cover the range evenly") {
+    std::vector<int> counts(10);
+    for (uint64_t tick = 0; tick < 10000; ++tick) {
+      const int value = rng.below(10, tick);
+      REQUIRE(value >= 0);
+      REQUIRE(value < 10);
+      counts[value]++;
+    }
+    CHECK(*std::min_element(counts.begin(), counts.end()) > 900);
+    CHECK(*std::max_element(counts.begin(), counts.end()) < 1100);
+  }
+
+  SUBCASE("draws on other threads match with no shared state") {
+    std::vector<uint32_t> expected(4000);
+    for (uint64_t tick = 0; tick < expected.size(); ++tick) {
+      expected[tick] = rng.draw(tick);
+    }
+    std::vector<uint32_t> drawn(expected.size());
+    std::vector<std::thread> threads;
+    for (size_t first = 0; first < 4; ++first) {
+      // each thread takes every fourth tick, walking backwards
+      threads.emplace_back([&, first] {
+        for (size_t tick = drawn.size() - 4 + first; tick < drawn.size();
+             tick -= 4) {
+          drawn[tick] = rng.draw(tick);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    CHECK(drawn == expected);
+  }
+}
+
+// frames hold no padding, so equal states compare equal byte for byte
+static_assert(std::has_unique_object_representations_v<rewind_frame_t>);
+bool same_frame(const rewind_frame_t& lhs, const rewind_frame_t& rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(lhs)) == 0;
+}
+
+TEST_CASE("trajectory cache") {
+  // plays with the autopilot moving straight to where the ball will land
+  // only as each free run starts,
+  // recording every input so the game can be played back with step()
+  const auto play = [](breakout_t& breakout, const int ticks) {
+    for (int played = 0; played < ticks;) {
+      autopilot(breakout, 100);
+      played += breakout.step_free_flight(ticks - played);
+      if (played < ticks) {
+        breakout.step();
+        ++played;
+      }
+    }
+  };
+
+  // the game played back from its input log with step() alone
+  const auto replayed = [](const std::vector<uint8_t>& log,
+                           const int rewind_ticks) {
+    breakout_t stepped;
+    stepped.setup(0, 0, 101, 30);
+    stepped.enable_rewind(rewind_ticks);
+    for (size_t offset = 0; offset < log.size();) {
+      offset = replay_input(stepped, log, offset);
+    }
+    return stepped;
+  };
+
+  SUBCASE("free flight plays out exactly as step() does") {
+    for (const int slots : {0, 1, 2, 1024}) {
+      breakout_t breakout;
+      breakout.setup(0, 0, 101, 30);
+      breakout.enable_trajectory_cache(slots);
+      std::vector<uint8_t> log;
+      breakout.set_input_log(&log);
+      play(breakout, 3000);
+      CHECK(breakout.tick() == 3000);
+      CHECK(breakout.score() > 0);
+
+      const breakout_t stepped = replayed(log, 0);
+      CHECK(stepped.tick() == 3000);
+      CHECK(same_frame(stepped.frame(), breakout.frame()));
+      CHECK(stepped.blocks().block_ids_ == breakout.blocks().block_ids_);
+    }
+  }
+
+  SUBCASE("a single slot cache plays a game to the end") {
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    breakout.enable_trajectory_cache(1);
+    for (int tick = 0; tick < 100000; ++tick) {
+      const auto state = breakout.state();
+      if (
+        state == breakout_t::game_state_e::game_over
+        || state == breakout_t::game_state_e::game_complete) {
+        break;
+      }
+      if (state == breakout_t::game_state_e::preparing) {
+        breakout.launch_random();
+      }
+      breakout.step_n(100);
+    }
+    CHECK(breakout.trajectory_cache_stats().lookups_ > 0);
+    CHECK(breakout.score() > 0);
+  }
+
+  SUBCASE("free flight matches step() on free-form levels for two players") {
+    const auto setup = [](breakout_t& breakout) {
+      breakout.setup(0, 0, 101, 30);
+      breakout.set_players(2);
+      breakout.set_seed(3);
+      breakout.set_create_blocks_fn([](const breakout_t& breakout) {
+        return create_random_blocks(breakout, 600);
+      });
+      breakout.restart();
+    };
+    breakout_t breakout;
+    setup(breakout);
+    breakout.enable_trajectory_cache(1024);
+    std::vector<uint8_t> log;
+    breakout.set_input_log(&log);
+    for (int played = 0; played < 3000;) {
+      // the second paddle chases the ball as the first one plays
+      if (breakout.ball_position().x_ < breakout.paddle_position(1).x_) {
+        breakout.move_paddle_left(3, 1);
+      } else {
+        breakout.move_paddle_right(3, 1);
+      }
+      played += breakout.step_free_flight(3000 - played);
+      if (played < 3000) {
+        autopilot(breakout, 2);
+        breakout.step();
+        ++played;
+      }
+    }
+
+    breakout_t stepped;
+    setup(stepped);
+    for (size_t offset = 0; offset < log.size();) {
+      offset = replay_input(stepped, log, offset);
+    }
+    CHECK(breakout.score() > 0);
+    CHECK(stepped.tick() == breakout.tick());
+    CHECK(same_frame(stepped.frame(), breakout.frame()));
+    CHECK(stepped.blocks().block_ids_ == breakout.blocks().block_ids_);
+  }
+
+  SUBCASE("free flight hits blocks moved off the grid") {
+    // the first block is moved to a bar across the board below the grid
+    const auto moved_layout = [](const breakout_t& breakout, blocks_t& blocks) {
+      layout_blocks(breakout, blocks);
+      if (blocks.cell_map_.width_ == cell_map_width_e::none) {
+        const auto [width, height] = breakout.board_size();
+        build_cell_map(
+          blocks, vec2{width + 1, height + 1}, cell_map_width_e::int16);
+      }
+      set_block_cells(blocks, 0, 0, cell_rect_t{vec2{1, 22}, vec2{100, 22}});
+    };
+    const auto setup = [&moved_layout](breakout_t& breakout) {
+      breakout.setup(0, 0, 101, 30);
+      breakout.set_cell_map_width(cell_map_width_e::int16);
+      breakout.set_layout_blocks_fn(moved_layout);
+      breakout.restart();
+      breakout.launch_left();
+    };
+
+    breakout_t stepped;
+    setup(stepped);
+    breakout_t bulk;
+    setup(bulk);
+    for (int tick = 0; tick < 10; ++tick) {
+      stepped.step();
+    }
+    while (bulk.tick() < 10) {
+      bulk.step_n(10 - bulk.tick());
+    }
+    CHECK(stepped.blocks_remaining() == 98);
+    CHECK(same_frame(bulk.frame(), stepped.frame()));
+
+    // a cache filled on the grid is dropped once the block is moved
+    breakout_t cached;
+    cached.setup(0, 0, 101, 30);
+    cached.enable_trajectory_cache(1024);
+    cached.launch_left();
+    play(cached, 2000);
+    cached.set_cell_map_width(cell_map_width_e::int16);
+    cached.set_layout_blocks_fn(moved_layout);
+    cached.restart();
+    std::vector<uint8_t> log;
+    cached.set_input_log(&log);
+    cached.launch_left();
+    play(cached, 2000);
+
+    breakout_t replay;
+    setup(replay);
+    replay.restart();
+    for (size_t offset = 0; offset < log.size();) {
+      offset = replay_input(replay, log, offset);
+    }
+    CHECK(replay.tick() == 2000);
+    CHECK(same_frame(replay.frame(), cached.frame()));
+    CHECK(replay.blocks().block_ids_ == cached.blocks().block_ids_);
+  }
+
+  SUBCASE("runs cached before a rewind brings blocks back are dropped") {
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    breakout.enable_rewind(400);
+    breakout.enable_trajectory_cache(1024);
+    std::vector<uint8_t> log;
+    breakout.set_input_log(&log);
+    play(breakout, 1000);
+    const int blocks = breakout.blocks_remaining();
+    int ticks = 0;
+    for (; ticks < 300 && breakout.blocks_remaining() == blocks; ++ticks) {
+      play(breakout, 1);
+    }
+    play(breakout, 50);
+    REQUIRE(breakout.blocks_remaining() < blocks);
+    CHECK(breakout.rewind(ticks + 60) == ticks + 60);
+    CHECK(breakout.blocks_remaining() == blocks);
+    play(breakout, 1500);
+
+    const breakout_t stepped = replayed(log, 400);
+    CHECK(same_frame(stepped.frame(), breakout.frame()));
+    CHECK(stepped.blocks().block_ids_ == breakout.blocks().block_ids_);
+  }
+
+  SUBCASE("runs carry over from one game to the next") {
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    breakout.enable_trajectory_cache(4096);
+    for (uint64_t seed = 0; seed < 20; ++seed) {
+      breakout.set_seed(seed);
+      breakout.restart();
+      breakout.launch_random();
+      play(breakout, 2000);
+    }
+    const trajectory_cache_stats_t& stats = breakout.trajectory_cache_stats();
+    CHECK(stats.lookups_ > 0);
+    CHECK(stats.hit_rate() > 0.3);
+    // runs ending at a destroyed block are found again but turned away
+    CHECK(stats.invalidated_ > 0);
+  }
+}
+
+TEST_CASE("vector environment") {
+  constexpr int game_count = 4;
+  vector_env_t env(game_count, 101, 30);
+
+  std::vector<int8_t> actions(game_count, vector_env_t::launch);
+  std::vector<int32_t> obs(game_count * vector_env_t::observation_size);
+  std::vector<float> reward(game_count);
+  std::vector<uint8_t> done(game_count);
+
+  SUBCASE("step writes an observation for every game") {
+    actions[1] = vector_env_t::right;
+    env.step(actions.data(), obs.data(), reward.data(), done.data());
+    for (int id = 0; id < game_count; ++id) {
+      const int32_t* game_obs =
+        obs.data() + id * vector_env_t::observation_size;
+      CHECK(game_obs[0] == env.game(id).paddle_position().x_);
+      CHECK(game_obs[1] == env.game(id).ball_position().x_);
+      CHECK(game_obs[7] == env.game(id).blocks_remaining());
+    }
+    // the game that moved right has not launched
+    CHECK(!env.game(1).launched());
+    CHECK(env.game(0).launched());
+  }
+
+  SUBCASE("rewards add up to the score and done is set at game over") {
+    std::vector<float> total(game_count, 0.0f);
+    for (int tick = 0; tick < 100000 && !done[0]; ++tick) {
+      env.step(actions.data(), obs.data(), reward.data(), done.data());
+      for (int id = 0; id < game_count; ++id) {
+        total[id] += reward[id];
+      }
+    }
+    CHECK(done[0]);
+    CHECK(env.game(0).state() == breakout_t::game_state_e::game_over);
+    CHECK(total[0] == float(env.game(0).score()));
+    CHECK(total[0] > 0.0f);
+
+    const int32_t ids[] = {0};
+    std::vector<int32_t> reset_obs(vector_env_t::observation_size);
+    env.reset(ids, 1, reset_obs.data());
+    CHECK(env.game(0).state() == breakout_t::game_state_e::preparing);
+    CHECK(reset_obs[5] == env.game(0).starting_lives());
+    CHECK(reset_obs[6] == 0);
+
+    // the next step after a reset only rewards new points
+    env.step(actions.data(), obs.data(), reward.data(), done.data());
+    CHECK(reward[0] == 0.0f);
+    CHECK(!done[0]);
+  }
+}
+
+// screen scrapes the display calls into a grid of raster cells
+struct display_raster_test_t : public display_t {
+  display_raster_test_t(const vec2 offset, const vec2 size)
+    : offset_(offset), size_(size), cells_(size.x_ * size.y_, raster_empty) {}
+  vec2 offset_;
+  vec2 size_;
+  uint8_t value_ = raster_empty;
+  std::vector<uint8_t> cells_;
+  void output(int x, int y, std::string_view) override {
+    x -= offset_.x_;
+    y -= offset_.y_;
+    if (x >= 0 && y >= 0 && x < size_.x_ && y < size_.y_) {
+      cells_[y * size_.x_ + x] = value_;
+    }
+  }
+};
+
+TEST_CASE("observation rasterizer") {
+  breakout_t breakout;
+  breakout.setup(10, 5, 101, 30);
+  breakout.set_create_blocks_fn([](const breakout_t& breakout) {
+    auto blocks = ::create_blocks(breakout);
+    destroy_block(blocks, 3, 2);
+    return blocks;
+  });
+  breakout.restart();
+  breakout.launch_right();
+  for (int i = 0; i < 5; ++i) {
+    breakout.step();
+  }
+
+  // the cells a game is displayed in, valued as the rasterizer would
+  const auto displayed = [](const breakout_t& breakout) {
+    display_raster_test_t display(
+      breakout.board_offset(), raster_size(breakout, 1));
+    const std::string_view glyph = "*";
+    display.value_ = raster_wall;
+    breakout.display_board(display, glyph, glyph, glyph, glyph, glyph, glyph);
+    display.value_ = raster_block;
+    breakout.display_blocks(display, glyph);
+    display.value_ = raster_paddle;
+    breakout.display_paddle(display, glyph);
+    display.value_ = raster_ball;
+    breakout.display_ball(display, glyph);
+    return display.cells_;
+  };
+
+  SUBCASE("matches what is displayed") {
+    const vec2 size = raster_size(breakout, 1);
+    CHECK(size == vec2{102, 31});
+    std::vector<uint8_t> raster(size.x_ * size.y_);
+    rasterize(breakout, raster.data());
+    CHECK(raster == displayed(breakout));
+  }
+
+  SUBCASE("every player's paddle is drawn") {
+    breakout_t two_players;
+    two_players.set_players(2);
+    two_players.setup(10, 5, 101, 30);
+    REQUIRE(two_players.players() == 2);
+    const vec2 size = raster_size(two_players, 1);
+    std::vector<uint8_t> raster(size.x_ * size.y_);
+    rasterize(two_players, raster.data());
+    CHECK(raster == displayed(two_players));
+    for (int player = 0; player < 2; ++player) {
+      const auto [x, y] = two_players.paddle_position(player);
+      CHECK(raster[y * size.x_ + x] == raster_paddle);
+    }
+  }
+
+  SUBCASE("downsampled cells keep the highest value") {
+    const vec2 size = raster_size(breakout, 2);
+    CHECK(size == vec2{51, 16});
+    std::vector<uint8_t> raster(size.x_ * size.y_);
+    rasterize(breakout, raster.data(), 2);
+
+    const auto [ball_x, ball_y] = breakout.ball_position();
+    CHECK(raster[(ball_y / 2) * size.x_ + ball_x / 2] == raster_ball);
+    CHECK(raster[0] == raster_wall);
+    CHECK(
+      std::count(raster.begin(), raster.end(), uint8_t(raster_ball)) == 1);
+  }
+
+  SUBCASE("stacked frames keep the newest frame last") {
+    const vec2 size = raster_size(breakout, 1);
+    const int frame_size = size.x_ * size.y_;
+    std::vector<uint8_t> frames(frame_size * 3);
+    rasterize_stacked(breakout, frames.data(), 3);
+    const std::vector<uint8_t> first(
+      frames.begin() + frame_size * 2, frames.end());
+
+    breakout.step();
+    rasterize_stacked(breakout, frames.data(), 3);
+    CHECK(std::equal(
+      first.begin(), first.end(), frames.begin() + frame_size,
+      frames.begin() + frame_size * 2));
+    CHECK(!std::equal(
+      first.begin(), first.end(), frames.begin() + frame_size * 2,
+      frames.end()));
+  }
+}
+
+TEST_CASE("level search") {
+  level_search_config_t config;
+  config.candidates_ = 24;
+  config.games_per_candidate_ = 4;
+  config.keep_ = 4;
+  config.threads_ = 1;
+  const level_search_result_t result = search_levels(config);
+  REQUIRE(result.best_.size() == 4);
+  CHECK(result.evaluated_ == 24);
+  CHECK(result.candidates_per_second() > 0.0);
+
+  SUBCASE("levels kept are the closest to the target difficulty") {
+    const int lives = breakout_t{}.starting_lives();
+    for (size_t i = 1; i < result.best_.size(); ++i) {
+      CHECK(
+        result.best_[i - 1].distance(config.target_difficulty_, lives)
+        <= result.best_[i].distance(config.target_difficulty_, lives));
+    }
+    // any candidate can be rebuilt from the search seed on its own
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    bool rebuilt = false;
+    for (int candidate = 0; candidate < config.candidates_; ++candidate) {
+      const level_candidate_t level =
+        sample_level(breakout, config.seed_, candidate);
+      rebuilt = rebuilt || level.seed_ == result.best_[0].seed_;
+    }
+    CHECK(rebuilt);
+  }
+
+  SUBCASE("the search gives the same levels on any number of threads") {
+    config.threads_ = 3;
+    const level_search_result_t threaded = search_levels(config);
+    REQUIRE(threaded.best_.size() == result.best_.size());
+    for (size_t i = 0; i < result.best_.size(); ++i) {
+      CHECK(threaded.best_[i].seed_ == result.best_[i].seed_);
+      CHECK(threaded.best_[i].lives_lost_ == result.best_[i].lives_lost_);
+      CHECK(threaded.best_[i].clear_ticks_ == result.best_[i].clear_ticks_);
+    }
+  }
+
+  SUBCASE("level files load back and can be played") {
+    const level_candidate_t& best = result.best_[0];
+    std::stringstream file;
+    save_level(file, best.rects_);
+    const auto loaded = load_level(file);
+    REQUIRE(loaded);
+    REQUIRE(loaded->size() == best.rects_.size());
+
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    breakout.set_layout_blocks_fn(level_blocks_fn(*loaded));
+    breakout.restart();
+    CHECK(breakout.blocks_remaining() == int(best.rects_.size()));
+    for (size_t i = 0; i < loaded->size(); ++i) {
+      CHECK((*loaded)[i].min_ == best.rects_[i].min_);
+      CHECK((*loaded)[i].max_ == best.rects_[i].max_);
+    }
+
+    std::stringstream bad("breakout-session 1 0");
+    CHECK(!load_level(bad));
+    std::stringstream inverted("breakout-level 1 1\n10 4 5 4\n");
+    CHECK(!load_level(inverted));
+    std::stringstream huge("breakout-level 1 1\n0 0 2000000000 4\n");
+    CHECK(!load_level(huge));
+    std::stringstream negative("breakout-level 1 1\n-5 4 5 4\n");
+    CHECK(!load_level(negative));
+    std::stringstream too_many("breakout-level 1 99999999999\n");
+    CHECK(!load_level(too_many));
+  }
+
+  SUBCASE("levels are evaluated as the batch runner plays games") {
+    level_candidate_t level = result.best_[0];
+    level.games_ = level.cleared_ = level.timed_out_ = level.lives_lost_ = 0;
+    level.clear_ticks_ = 0;
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    evaluate_level(
+      breakout, level, config.games_per_candidate_, config.max_ticks_,
+      config.bot_);
+    CHECK(level.games_ == result.best_[0].games_);
+    CHECK(level.lives_lost_ == result.best_[0].lives_lost_);
+    CHECK(level.cleared_ == result.best_[0].cleared_);
+    CHECK(level.clear_ticks_ == result.best_[0].clear_ticks_);
+  }
+
+  SUBCASE("a negative candidate count searches nothing") {
+    config.candidates_ = -3;
+    const level_search_result_t none = search_levels(config);
+    CHECK(none.evaluated_ == 0);
+    CHECK(none.best_.empty());
+  }
+}
+
+TEST_CASE("recorded sessions") {
+  session_t session{vec2{10, 5}, vec2{101, 30}, 20};
+  breakout_t breakout = start_session(session);
+  breakout.set_input_log(&session.inputs_);
+
+  // play through a few lives with some rewinds and a restart along the way
+  std::vector<rewind_frame_t> frames{breakout.frame()};
+  for (int tick = 0; tick < 600; ++tick) {
+    if (tick == 450) {
+      breakout.restart();
+    } else if (tick % 97 == 0) {
+      breakout.rewind(15);
+    }
+    autopilot(breakout, 2);
+    breakout.step();
+    frames.push_back(breakout.frame());
+  }
+
+  SUBCASE("replaying the inputs repeats the game") {
+    breakout_t replayed = start_session(session);
+    size_t input = 0;
+    int tick = 0;
+    while (input < session.inputs_.size()) {
+      const bool step = session.inputs_[input] == uint8_t(input_op_e::step);
+      input = replay_input(replayed, session.inputs_, input);
+      tick += step ? 1 : 0;
+      if (step) {
+        CHECK(same_frame(replayed.frame(), frames[tick]));
+      }
+    }
+    CHECK(tick == 600);
+  }
+
+  SUBCASE("sessions survive a save and load") {
+    std::stringstream stream;
+    save_session(stream, session);
+    const std::optional<session_t> loaded = load_session(stream);
+    REQUIRE(loaded.has_value());
+    CHECK(loaded->board_offset_ == session.board_offset_);
+    CHECK(loaded->board_size_ == session.board_size_);
+    CHECK(loaded->rewind_ticks_ == session.rewind_ticks_);
+    CHECK(loaded->inputs_ == session.inputs_);
+
+    std::stringstream garbage("not a session");
+    CHECK(!load_session(garbage).has_value());
+  }
+
+  SUBCASE("a level played is restored on replay") {
+    session_t level_session{vec2{10, 5}, vec2{101, 30}, 20};
+    level_session.level_ = {
+      cell_rect_t{vec2{10, 4}, vec2{20, 4}},
+      cell_rect_t{vec2{40, 8}, vec2{44, 10}},
+      cell_rect_t{vec2{70, 6}, vec2{90, 6}}};
+    breakout_t played = start_session(level_session);
+    played.set_input_log(&level_session.inputs_);
+    for (int tick = 0; tick < 300; ++tick) {
+      autopilot(played, 2);
+      played.step();
+    }
+
+    std::stringstream stream;
+    save_session(stream, level_session);
+    const std::optional<session_t> loaded = load_session(stream);
+    REQUIRE(loaded.has_value());
+    CHECK(loaded->level_.size() == level_session.level_.size());
+
+    breakout_t replayed = start_session(*loaded);
+    CHECK(replayed.blocks_remaining() == 3);
+    for (size_t input = 0; input < loaded->inputs_.size();) {
+      input = replay_input(replayed, loaded->inputs_, input);
+    }
+    CHECK(same_frame(replayed.frame(), played.frame()));
+  }
+
+  SUBCASE("the index holds the state of every tick") {
+    for (const int keyframe_interval : {1, 32, 1000}) {
+      for (const int thread_count : {1, 4}) {
+        const session_index_t index(session, keyframe_interval, thread_count);
+        REQUIRE(index.ticks() == 600);
+        for (int tick = 0; tick <= index.ticks(); ++tick) {
+          CHECK(same_frame(index.frame(tick), frames[tick]));
+        }
+      }
+    }
+  }
+
+  SUBCASE("seeking restores the game at any tick") {
+    const session_index_t index(session, 32);
+    for (const int tick : {0, 1, 31, 32, 33, 97, 98, 450, 451, 599, 600}) {
+      const breakout_t sought = index.seek(tick);
+      CHECK(same_frame(sought.frame(), frames[tick]));
+    }
+
+    // given the same inputs the sought game carries on as the original did
+    breakout_t sought = index.seek(300);
+    autopilot(sought, 2);
+    sought.step();
+    CHECK(same_frame(sought.frame(), index.frame(301)));
+  }
+}
+
+TEST_CASE("two player lockstep") {
+  SUBCASE("the second paddle bounces the ball and is rewound") {
+    breakout_t breakout;
+    breakout.set_players(2);
+    breakout.setup(10, 5, 101, 30);
+    breakout.enable_rewind(10);
+    CHECK(breakout.players() == 2);
+    CHECK(breakout.paddle_position(0).x_ < breakout.paddle_position(1).x_);
+
+    // park the second paddle where the ball comes down below the blocks
+    breakout.launch_right();
+    while (breakout.ball_velocity().y_ < 0
+           || breakout.ball_position().y_ < 20) {
+      breakout.step();
+    }
+    const int landing_x = *predict_landing_x(breakout);
+    REQUIRE(
+      (landing_x < breakout.paddle_left_edge(0)
+       || landing_x > breakout.paddle_right_edge(0)));
+    const int paddle_x = breakout.paddle_position(1).x_;
+    if (landing_x > paddle_x) {
+      breakout.move_paddle_right(landing_x - paddle_x, 1);
+    } else {
+      breakout.move_paddle_left(paddle_x - landing_x, 1);
+    }
+    CHECK(breakout.paddle_position(1).x_ == landing_x);
+    while (breakout.ball_velocity().y_ > 0 && breakout.launched()) {
+      breakout.step();
+    }
+    CHECK(breakout.launched());
+    CHECK(breakout.ball_position().y_ == breakout.paddle_position(1).y_);
+
+    breakout.rewind(5);
+    CHECK(breakout.paddle_position(1).x_ == landing_x);
+  }
+
+  SUBCASE("peers agree despite late inputs") {
+    constexpr int ticks = 400;
+    constexpr int input_delay = 2;
+    lockstep_t peers[] = {
+      lockstep_t(0, input_delay, 16, 101, 30),
+      lockstep_t(1, input_delay, 16, 101, 30)};
+    // player 1's inputs arrive 6 ticks late, player 0's immediately
+    const int latency[] = {0, 6};
+    struct in_flight_t {
+      int arrives_;
+      lockstep_message_t message_;
+    };
+    std::deque<in_flight_t> links[2]; // messages towards each player
+    std::vector<uint8_t> inputs[2];
+
+    for (int tick = 0; tick < ticks + 16; ++tick) {
+      for (int player = 0; player < 2; ++player) {
+        auto& link = links[player];
+        while (!link.empty() && link.front().arrives_ <= tick) {
+          peers[player].receive(link.front().message_);
+          link.pop_front();
+        }
+      }
+      for (int player = 0; player < 2; ++player) {
+        lockstep_t& peer = peers[player];
+        if (peer.needs_local_input()) {
+          // hold a direction for a while then switch, launching when ready
+          uint8_t input = (tick / (11 + player * 7)) % 2 == 0 ? lockstep_left
+                                                              : lockstep_right;
+          if (player == 0 && tick % 40 == 0) {
+            input |= lockstep_launch;
+          }
+          inputs[player].push_back(input);
+          uint8_t bytes[lockstep_message_size];
+          encode_lockstep_message(peer.local_input(input), bytes);
+          links[1 - player].push_back(in_flight_t{
+            tick + latency[player], decode_lockstep_message(bytes)});
+        }
+        if (peer.tick() < ticks) {
+          peer.advance();
+        }
+      }
+    }
+
+    breakout_t reference;
+    reference.set_players(2);
+    reference.setup(0, 0, 101, 30);
+    for (int tick = 0; tick < ticks; ++tick) {
+      for (int player = 0; player < 2; ++player) {
+        const uint8_t input =
+          tick < input_delay ? 0 : inputs[player][tick - input_delay];
+        if ((input & lockstep_left) != 0) {
+          reference.move_paddle_left(lockstep_t::paddle_speed, player);
+        }
+        if ((input & lockstep_right) != 0) {
+          reference.move_paddle_right(lockstep_t::paddle_speed, player);
+        }
+        if ((input & lockstep_launch) != 0) {
+          reference.launch_left();
+        }
+      }
+      reference.step();
+    }
+
+    for (auto& peer : peers) {
+      peer.resolve();
+      CHECK(peer.tick() == ticks);
+      CHECK(peer.confirmed_tick() >= ticks);
+      const breakout_t& game = peer.game();
+      CHECK(game.ball_position() == reference.ball_position());
+      CHECK(game.paddle_position(0) == reference.paddle_position(0));
+      CHECK(game.paddle_position(1) == reference.paddle_position(1));
+      CHECK(game.score() == reference.score());
+      CHECK(game.blocks_remaining() == reference.blocks_remaining());
+      // the events of the ticks rolled back were taken back with them
+      CHECK(game.events().written() == reference.events().written());
+      CHECK(!peer.desynced());
+    }
+    // only the peer hearing from the laggy player had to roll back
+    CHECK(peers[0].metrics().rollbacks_ > 0);
+    CHECK(peers[0].metrics().resimulated_ticks_ > 0);
+    CHECK(peers[1].metrics().rollbacks_ == 0);
+    CHECK(peers[0].metrics().stalls_ == 0);
+  }
+
+  SUBCASE("inputs received twice or out of reach are rejected") {
+    lockstep_t peer(0, 0, 8, 101, 30);
+    for (int tick = 0; tick < 20; ++tick) {
+      CHECK(peer.receive(lockstep_message_t{uint32_t(tick), 0, 0}));
+      peer.local_input(0);
+      REQUIRE(peer.advance());
+    }
+    // the other player's input for an old tick changes after the fact
+    CHECK(!peer.receive(lockstep_message_t{2, 0, lockstep_left}));
+    // or comes from further ahead than it could have played
+    CHECK(!peer.receive(lockstep_message_t{UINT32_MAX, 0, lockstep_left}));
+    CHECK(!peer.receive(lockstep_message_t{29, 0, lockstep_left}));
+    CHECK(peer.receive(lockstep_message_t{28, 0, lockstep_left}));
+    CHECK(!peer.receive(lockstep_message_t{28, 0, lockstep_right}));
+    CHECK(peer.metrics().rejected_ == 4);
+    CHECK(peer.resolve());
+    CHECK(!peer.desynced());
+    peer.local_input(0);
+    CHECK(peer.advance());
+  }
+
+  SUBCASE("a rewind takes back the events of the ticks it undoes") {
+    breakout_t breakout;
+    breakout.setup(10, 5, 101, 30);
+    breakout.enable_rewind(100);
+    breakout.launch_left();
+    const uint64_t before = breakout.events().written();
+    while (breakout.events().written() == before) {
+      breakout.step();
+    }
+    const uint64_t written = breakout.events().written();
+    uint64_t cursor = before;
+    int seen = 0;
+    breakout.events().drain(cursor, [&seen](const auto&) { ++seen; });
+    CHECK(seen == int(written - before));
+
+    breakout.rewind(1);
+    CHECK(breakout.events().written() == before);
+    // a consumer draining after the rewind sees the events again as the tick
+    // is replayed
+    CHECK(
+      breakout.events().drain(cursor, [&seen](const auto&) { ++seen; }) == 0);
+    CHECK(cursor == before);
+    breakout.step();
+    CHECK(breakout.events().written() == written);
+    CHECK(
+      breakout.events().drain(cursor, [&seen](const auto&) { ++seen; }) == 0);
+    CHECK(seen == 2 * int(written - before));
+  }
+
+}
+
+TEST_CASE("game server") {
+  SUBCASE("timers fire after their delay, however many laps away") {
+    timer_wheel_t wheel(8);
+    wheel.schedule(1, 3);
+    wheel.schedule(2, 8);
+    wheel.schedule(3, 21);
+    CHECK(wheel.pending() == 3);
+
+    std::vector<std::pair<uint64_t, uint64_t>> fired; // token, time
+    for (int tick = 0; tick < 30; ++tick) {
+      wheel.advance([&](const uint64_t token) {
+        fired.emplace_back(token, wheel.now());
+        if (token == 1 && fired.size() == 1) {
+          wheel.schedule(4, 8); // rescheduling into the slot being fired
+        }
+      });
+    }
+    const std::vector<std::pair<uint64_t, uint64_t>> expected = {
+      {1, 3}, {2, 8}, {4, 11}, {3, 21}};
+    CHECK(fired == expected);
+    CHECK(wheel.pending() == 0);
+  }
+
+  SUBCASE("state updates keep a client copy of the game in sync") {
+    breakout_t game;
+    game.setup(0, 0, 101, 30);
+    blocks_t client_blocks = create_blocks(game);
+    update_cursor_t cursor;
+    std::vector<uint8_t> bytes;
+    state_update_t update;
+
+    size_t largest = 0;
+    for (uint32_t tick = 1; tick <= 800; ++tick) {
+      if (game.state() == breakout_t::game_state_e::game_over) {
+        game.restart();
+        cursor = update_cursor_t{};
+      }
+      autopilot(game, 2);
+      game.step();
+      // only every third update gets through
+      if (tick % 3 != 0) {
+        continue;
+      }
+      bytes.clear();
+      encode_state_update(game, tick, cursor, bytes);
+      largest = std::max(largest, bytes.size());
+      REQUIRE(decode_state_update(
+        bytes.data(), bytes.data() + bytes.size(), update));
+      cursor.blocks_remaining_ = game.blocks_remaining();
+      apply_state_update(client_blocks, update);
+
+      CHECK(update.tick_ == tick);
+      CHECK(update.frame_.ball_x_ == game.ball_position().x_);
+      CHECK(update.frame_.ball_y_ == game.ball_position().y_);
+      CHECK(update.frame_.ball_velocity_x_ == game.ball_velocity().x_);
+      CHECK(update.frame_.ball_velocity_y_ == game.ball_velocity().y_);
+      CHECK(update.frame_.paddle_x_ == game.paddle_position().x_);
+      CHECK(update.frame_.state_ == uint8_t(game.state()));
+      CHECK(update.frame_.score_ == game.score());
+      CHECK(blocks_remaining(client_blocks) == game.blocks_remaining());
+      CHECK(client_blocks.block_ids_ == game.blocks().block_ids_);
+    }
+    CHECK(game.score() > 0);
+    CHECK(largest < 24);
+
+    CHECK(!decode_state_update(bytes.data(), bytes.data() + 3, update));
+  }
+}
+
+TEST_CASE("spectator stream") {
+  breakout_t game;
+  game.setup(0, 0, 101, 30);
+  spectator_encoder_t encoder(100);
+  spectator_broadcast_t broadcast;
+
+  const auto matches = [&game](const spectator_view_t& view) {
+    const rewind_frame_t frame = game.frame();
+    bool alive_match = true;
+    for (int id = 0; id < int(view.alive_.size()); ++id) {
+      const int cols = game.blocks().col_count;
+      const bool destroyed =
+        block_destroyed(game.blocks(), id % cols, id / cols);
+      alive_match = alive_match && (view.alive_[id] == 0) == destroyed;
+    }
+    return view.synced_ && alive_match
+        && view.frame_.paddle_x_ == frame.paddle_x_
+        && view.frame_.ball_x_ == frame.ball_x_
+        && view.frame_.ball_y_ == frame.ball_y_
+        && view.frame_.ball_velocity_x_ == frame.ball_velocity_x_
+        && view.frame_.ball_velocity_y_ == frame.ball_velocity_y_
+        && view.frame_.state_ == frame.state_
+        && view.frame_.lives_ == frame.lives_
+        && view.frame_.score_ == frame.score_
+        && view.frame_.blocks_remaining_ == frame.blocks_remaining_;
+  };
+
+  SUBCASE("a queue stays put while others subscribe") {
+    const int first = broadcast.subscribe();
+    const auto& queue = broadcast.queue(first);
+    for (int i = 0; i < 100; ++i) {
+      broadcast.subscribe();
+    }
+    game.step();
+    const spectator_frame_t frame = encoder.encode(game);
+    broadcast.publish(frame);
+    CHECK(&queue == &broadcast.queue(first));
+    REQUIRE(!queue.empty());
+    CHECK(queue.back().get() == frame.get());
+  }
+
+  SUBCASE("spectators follow the game, late joiners from the last keyframe") {
+    const int early = broadcast.subscribe();
+    std::optional<int> late;
+    spectator_view_t views[2];
+    size_t delta_bytes = 0;
+    int deltas = 0;
+    int single_byte_deltas = 0;
+    for (int tick = 0; tick < 700; ++tick) {
+      if (tick == 250) {
+        late = broadcast.subscribe();
+      }
+      if (tick == 600) {
+        game.restart();
+      }
+      autopilot(game, 2);
+      game.step();
+      const spectator_frame_t frame = encoder.encode(game);
+      if (((*frame)[0] & 0x80) == 0) {
+        delta_bytes += frame->size();
+        ++deltas;
+        single_byte_deltas += frame->size() == 1 ? 1 : 0;
+      }
+      broadcast.publish(frame);
+
+      for (int i = 0; i < (late ? 2 : 1); ++i) {
+        auto& queue = broadcast.queue(i == 0 ? early : *late);
+        // every subscriber holds the very same frame
+        CHECK(queue.back().get() == frame.get());
+        while (!queue.empty()) {
+          views[i].apply(*queue.front());
+          queue.pop_front();
+        }
+        CHECK(matches(views[i]));
+      }
+    }
+    CHECK(game.score() > 0);
+    CHECK(views[0].tick_ == 699);
+    CHECK(views[1].tick_ == 699);
+    // usually only the ball moved, which fits in a byte
+    CHECK(single_byte_deltas * 2 > deltas);
+    CHECK(double(delta_bytes) / deltas < 2.0);
+  }
+
+  SUBCASE("deltas are ignored until a keyframe arrives") {
+    encoder.encode(game); // keyframe
+    game.launch_left();
+    game.step();
+    spectator_view_t view;
+    CHECK(!view.apply(*encoder.encode(game)));
+    CHECK(!view.synced_);
+
+    encoder.force_keyframe();
+    game.step();
+    CHECK(view.apply(*encoder.encode(game)));
+    CHECK(matches(view));
+  }
+
+  SUBCASE("a restart onto another layout sends its rects in a keyframe") {
+    spectator_view_t view;
+    game.launch_left();
+    for (int tick = 0; tick < 200; ++tick) {
+      autopilot(game, 2);
+      game.step();
+      REQUIRE(view.apply(*encoder.encode(game)));
+    }
+    REQUIRE(game.blocks_remaining() < 99);
+    CHECK(view.rects_.empty());
+
+    // fewer blocks than remained, so no blocks appear to come back
+    game.set_layout_blocks_fn([](const breakout_t& breakout, blocks_t& blocks) {
+      layout_random_blocks(breakout, 300, blocks);
+    });
+    game.restart();
+    REQUIRE(game.blocks_remaining() < view.frame_.blocks_remaining_);
+    game.step();
+    const spectator_frame_t frame = encoder.encode(game);
+    CHECK(((*frame)[0] & 0x80) != 0);
+    CHECK(view.apply(*frame));
+    CHECK(matches(view));
+    CHECK(same_block_rects(view.rects_, game.blocks().rects_));
+  }
+}
+
+TEST_CASE("shared state") {
+  SUBCASE("a record holds the game and its blocks") {
+    breakout_t breakout;
+    breakout.setup(10, 5, 101, 30);
+    breakout.launch_right();
+    for (int tick = 0; tick < 40; ++tick) {
+      breakout.step();
+    }
+    REQUIRE(breakout.score() > 0);
+
+    auto state = std::make_unique<shared_state_t>();
+    shared_state_record_t record;
+    CHECK(!read_shared_state(*state, record));
+    write_shared_state(*state, make_shared_state_record(breakout, 40));
+    REQUIRE(read_shared_state(*state, record));
+    CHECK(record.tick_ == 40);
+    CHECK(record.ball_x_ == breakout.ball_position().x_);
+    CHECK(record.ball_y_ == breakout.ball_position().y_);
+    CHECK(record.score_ == breakout.score());
+    CHECK(record.blocks_remaining_ == breakout.blocks_remaining());
+    int alive = 0;
+    for (int row = 0; row < breakout.block_rows(); ++row) {
+      for (int col = 0; col < breakout.block_cols(); ++col) {
+        const int id = row * record.block_cols_ + col;
+        const bool bit = ((record.alive_[id / 64] >> (id % 64)) & 1) != 0;
+        CHECK(bit == !block_destroyed(breakout.blocks(), col, row));
+        alive += bit ? 1 : 0;
+      }
+    }
+    CHECK(alive == record.blocks_remaining_);
+  }
+
+  SUBCASE("readers never see a torn record") {
+    // every field of each record written is derived from one counter so a
+    // mix of two writes is easy to spot
+    const auto make_record = [](const uint32_t n) {
+      shared_state_record_t record = {};
+      record.tick_ = n;
+      record.score_ = int32_t(n * 3);
+      record.blocks_remaining_ = int32_t(n % 4096);
+      for (auto& word : record.alive_) {
+        word = uint64_t(n) * 0x9e3779b97f4a7c15ull;
+      }
+      return record;
+    };
+    const auto consistent = [](const shared_state_record_t& record) {
+      const uint32_t n = record.tick_;
+      bool same = record.score_ == int32_t(n * 3)
+               && record.blocks_remaining_ == int32_t(n % 4096);
+      for (const auto word : record.alive_) {
+        same = same && word == uint64_t(n) * 0x9e3779b97f4a7c15ull;
+      }
+      return same;
+    };
+
+    auto state = std::make_unique<shared_state_t>();
+    write_shared_state(*state, make_record(1));
+    std::atomic<bool> done = false;
+    std::atomic<int> torn = 0;
+    std::atomic<int> reads = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+      readers.emplace_back([&] {
+        uint32_t last = 0;
+        while (!done) {
+          shared_state_record_t record;
+          if (read_shared_state(*state, record, 1 << 20)) {
+            torn += consistent(record) && record.tick_ >= last ? 0 : 1;
+            last = record.tick_;
+            ++reads;
+          }
+        }
+      });
+    }
+    for (uint32_t n = 2; n < 200000; ++n) {
+      write_shared_state(*state, make_record(n));
+    }
+    done = true;
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    CHECK(torn == 0);
+    CHECK(reads > 0);
+  }
+}
+
+TEST_CASE("batch runner") {
+  batch_config_t config;
+  config.games_ = 300;
+  config.max_ticks_ = 5000;
+
+  // the same games played one after another on this thread
+  batch_result_t expected;
+  {
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    batch_autopilot_t policy;
+    for (uint64_t game = 0; game < config.games_; ++game) {
+      play_batch_game(breakout, game, config.max_ticks_, policy, expected);
+    }
+  }
+  CHECK(expected.games_ == 300);
+  CHECK(expected.completed_ > 0);
+  CHECK(expected.completed_ < 300);
+
+  SUBCASE("totals do not depend on the number of threads") {
+    for (const int threads : {1, 2, 3, 8}) {
+      config.threads_ = threads;
+      CHECK(run_batch(config, batch_autopilot_t{}) == expected);
+    }
+  }
+
+  SUBCASE("every game is played exactly once when work is stolen") {
+    // one worker gets all the slow games so the others must steal
+    config.threads_ = 4;
+    std::vector<std::atomic<int>> plays(config.games_);
+    const auto policy = [&plays](
+                          breakout_t& breakout, uint64_t game, int tick) {
+      if (tick == 0) {
+        plays[game]++;
+      }
+      if (game < 75) {
+        std::this_thread::yield();
+      }
+      batch_autopilot_t{}(breakout, game, tick);
+    };
+    CHECK(run_batch(config, policy) == expected);
+    CHECK(std::all_of(plays.begin(), plays.end(), [](const auto& count) {
+      return count == 1;
+    }));
+  }
+}
+
+TEST_CASE("packed games") {
+  CHECK(sizeof(packed_game_t) == 64);
+  CHECK(alignof(packed_game_t) == 64);
+
+  // plays a breakout_t and game 1 of a packed batch with the same inputs,
+  // the frames and blocks must match after every tick
+  const auto play_alongside = [](const int players) {
+    breakout_t breakout;
+    breakout.set_players(players);
+    breakout.setup(0, 0, 101, 30);
+    packed_games_t packed(breakout, 3);
+    const blocks_t& blocks = breakout.blocks();
+    int mismatches = 0;
+    for (uint64_t seed = 0; seed < 4; ++seed) {
+      breakout.set_seed(seed);
+      breakout.restart();
+      packed.restart(1);
+      const counter_rng_t rng(seed, rng_stream_e::policy);
+      for (int tick = 0; tick < 4000; ++tick) {
+        const int player = rng.below(players, uint64_t(tick), 2);
+        const int distance = 1 + rng.below(4, uint64_t(tick), 3);
+        switch (rng.below(8, uint64_t(tick))) {
+          case 0:
+            breakout.move_paddle_left(distance, player);
+            packed.move_paddle_left(1, distance, player);
+            break;
+          case 1:
+            breakout.move_paddle_right(distance, player);
+            packed.move_paddle_right(1, distance, player);
+            break;
+          case 2:
+            breakout.launch_left();
+            packed.launch_left(1);
+            break;
+          case 3:
+            breakout.launch_right();
+            packed.launch_right(1);
+            break;
+          default: {
+            // follow the ball so the games last
+            const int ball_x = breakout.ball_position().x_;
+            const int paddle_x = breakout.paddle_position(player).x_;
+            if (ball_x < paddle_x) {
+              breakout.move_paddle_left(distance, player);
+              packed.move_paddle_left(1, distance, player);
+            } else if (ball_x > paddle_x) {
+              breakout.move_paddle_right(distance, player);
+              packed.move_paddle_right(1, distance, player);
+            }
+          }
+        }
+        breakout.step();
+        packed.step(1);
+        mismatches += !same_frame(breakout.frame(), packed.frame(1));
+        mismatches += packed.game(1).tick_ != breakout.tick();
+      }
+      // the game got as far as hitting blocks
+      mismatches += breakout.blocks_remaining() == 99;
+      for (int row = 0; row < blocks.row_count; ++row) {
+        for (int col = 0; col < blocks.col_count; ++col) {
+          mismatches += packed.block_alive(1, col, row)
+                     == block_destroyed(blocks, col, row);
+        }
+      }
+    }
+    // the games either side are left alone
+    for (const int game : {0, 2}) {
+      mismatches += packed.game(game).tick_ != 0;
+      mismatches += packed.game(game).blocks_remaining_ != 99;
+    }
+    return mismatches;
+  };
+
+  SUBCASE("a single player plays as breakout_t") {
+    CHECK(play_alongside(1) == 0);
+  }
+
+  SUBCASE("two players play as breakout_t") {
+    CHECK(play_alongside(2) == 0);
+  }
+
+  SUBCASE("a batch takes a cache line per game and a bit per block") {
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    const packed_games_t packed(breakout, 1000);
+    CHECK(packed.size() == 1000);
+    CHECK(packed.layout().words_per_row_ == 1);
+    CHECK(packed.bytes() == sizeof(packed) + 1000 * (64 + 9 * 8));
+  }
+
+  SUBCASE("grids of more blocks than an int16 holds are counted") {
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    breakout.set_layout_blocks_fn(
+      [](const breakout_t& breakout, blocks_t& blocks) {
+        blocks_t dimensions = grid_dimensions(breakout);
+        dimensions.col_count = 400;
+        dimensions.row_count = 100;
+        set_block_dimensions(blocks, dimensions);
+        blocks.rects_.clear();
+        relayout_blocks(blocks);
+      });
+    breakout.restart();
+    const packed_games_t packed(breakout, 1);
+    CHECK(packed.game(0).blocks_remaining_ == 40000);
+    CHECK(packed.frame(0).blocks_remaining_ == 40000);
+  }
+
+  SUBCASE("only the standard grid can be packed") {
+    breakout_t breakout;
+    breakout.setup(0, 0, 101, 30);
+    breakout.set_layout_blocks_fn(
+      level_blocks_fn({cell_rect_t{vec2{10, 4}, vec2{20, 4}}}));
+    breakout.restart();
+    CHECK_THROWS_AS(packed_games_t(breakout, 1), std::invalid_argument);
+  }
+}
+
+// keeps the glyph last written to each cell of an area of the screen
+struct display_screen_t : public display_t {
+  vec2 origin_;
+  vec2 size_;
+  std::vector<std::string> cells_;
+  int outputs_ = 0;
+  display_screen_t(const vec2 origin, const vec2 size)
+    : origin_(origin), size_(size), cells_(size.x_ * size.y_, " ") {}
+  void output(int x, int y, std::string_view glyph) override {
+    x -= origin_.x_;
+    y -= origin_.y_;
+    if (x >= 0 && y >= 0 && x < size_.x_ && y < size_.y_) {
+      cells_[y * size_.x_ + x] = std::string(glyph);
+    }
+    outputs_++;
+  }
+};
+
+TEST_CASE("render layers") {
+  breakout_t breakout;
+  breakout.setup(10, 5, 101, 30);
+  breakout.enable_rewind(50);
+  // utf-8 box drawing and block glyphs, as the terminal front end uses
+  const std::string_view border = "\xE2\x94\x81";
+  const std::string_view side = "\xE2\x94\x83";
+  const std::string_view corner = "\xE2\x94\x8F";
+  const std::string_view paddle = "\xE2\x96\x91";
+  const std::string_view block = "\xE2\x96\x92";
+  glyph_table_t table;
+  const breakout_glyphs_t glyphs{
+    table.intern(border), table.intern(side), table.intern(corner),
+    table.intern(corner), table.intern(corner), table.intern(corner),
+    table.intern(paddle), table.intern(block), table.intern("o")};
+  breakout_layers_t layers(glyphs);
+  const vec2 origin = breakout.board_offset();
+  const vec2 size = {101 + 1 + breakout_label_width, 30 + 1};
+  display_screen_t screen(origin, size);
+  glyph_resolver_t to_screen(table, screen);
+
+  // the screen drawn from scratch with strings, in layer order
+  const auto redrawn = [&] {
+    display_screen_t expected(origin, size);
+    glyph_resolver_t text(table, expected);
+    breakout.display_board(
+      expected, border, side, corner, corner, corner, corner);
+    const int label_x = breakout_layers_t::label_x(breakout);
+    draw_text(text, label_x, origin.y_ + 1, "Lives:");
+    draw_text(text, label_x, origin.y_ + 3, "Score:");
+    draw_text(text, label_x, origin.y_ + 5, "Blocks:");
+    const auto state = breakout.state();
+    if (
+      state != breakout_t::game_state_e::game_over
+      && state != breakout_t::game_state_e::game_complete) {
+      breakout.display_blocks(expected, block);
+      breakout.display_paddle(expected, paddle);
+      breakout.display_ball(expected, std::string_view{"o"});
+    }
+    draw_number(text, label_x + 8, origin.y_ + 1, breakout.lives());
+    draw_number(text, label_x + 8, origin.y_ + 3, breakout.score());
+    draw_number(text, label_x + 8, origin.y_ + 5, breakout.blocks_remaining());
+    return expected.cells_;
+  };
+
+  layers.update(breakout);
+  CHECK(layers.layers().composite(to_screen) == size.x_ * size.y_);
+  CHECK(screen.cells_ == redrawn());
+
+  SUBCASE("composites to the screen a full redraw gives") {
+    int mismatches = 0;
+    int board_redraws = 0;
+    int blocks_redraws = 0;
+    int blocks_erased = 0; // frames that only erased the blocks destroyed
+    int game_overs = 0;
+    int frame = 0;
+    const auto update = [&] {
+      layers.update(breakout);
+      board_redraws +=
+        !layers.layers().layer(render_layer_e::board).changed().empty();
+      const size_t blocks_changed =
+        layers.layers().layer(render_layer_e::blocks).changed().size();
+      blocks_redraws += blocks_changed != 0;
+      blocks_erased += blocks_changed != 0 && blocks_changed < 20;
+      layers.layers().composite(to_screen);
+      ++frame;
+      mismatches += screen.cells_ != redrawn();
+    };
+    for (int game = 0; game < 3; ++game) {
+      while (breakout.state() != breakout_t::game_state_e::game_over
+             && frame < 1500 * (game + 1)) {
+        if (breakout.state() == breakout_t::game_state_e::preparing) {
+          breakout.launch_random();
+        }
+        if (frame % 400 >= 100) { // wander off now and then to lose lives
+          autopilot(breakout, 2);
+        }
+        breakout.step();
+        if (frame % 500 == 499) {
+          breakout.rewind(20);
+        }
+        update();
+      }
+      game_overs += breakout.state() == breakout_t::game_state_e::game_over;
+      breakout.restart();
+      update();
+    }
+    CHECK(mismatches == 0);
+    CHECK(game_overs > 0);
+    CHECK(board_redraws == 0);
+    CHECK(blocks_redraws > 0);
+    CHECK(blocks_redraws < frame / 10);
+    CHECK(blocks_erased > 0);
+    CHECK(blocks_erased < blocks_redraws);
+  }
+
+  SUBCASE("a frame emits only the cells that changed") {
+    breakout.launch_left();
+    breakout.step();
+    layers.update(breakout);
+    screen.outputs_ = 0;
+    // the ball moves a cell diagonally, the old and new cell are emitted
+    CHECK(layers.layers().composite(to_screen) == 2);
+    CHECK(screen.outputs_ == 2);
+    CHECK(screen.cells_ == redrawn());
+    layers.update(breakout);
+    CHECK(layers.layers().composite(to_screen) == 0);
+  }
+
+  SUBCASE("invalidating re-emits every cell") {
+    layers.invalidate();
+    layers.update(breakout);
+    CHECK(layers.layers().composite(to_screen) == size.x_ * size.y_);
+    CHECK(screen.cells_ == redrawn());
+  }
+}
+
+TEST_CASE("glyph table") {
+  glyph_table_t table;
+
+  SUBCASE("printable ascii is its own id") {
+    CHECK(table.intern("a") == 'a');
+    CHECK(table.intern(" ") == ' ');
+    CHECK(table.resolve('~') == "~");
+    CHECK(table.interned() == 0);
+  }
+
+  SUBCASE("other glyphs are interned once each") {
+    const glyph_id_t ball = table.intern("\xE2\x98\xBB");
+    const glyph_id_t block = table.intern("\xE2\x96\x92");
+    CHECK(ball >= first_interned_glyph);
+    CHECK(block != ball);
+    CHECK(table.intern(std::string("\xE2\x98\xBB")) == ball);
+    CHECK(table.resolve(ball) == "\xE2\x98\xBB");
+    CHECK(table.resolve(block) == "\xE2\x96\x92");
+    CHECK(table.interned() == 2);
+  }
+
+  SUBCASE("no glyph is empty and interning stops once ids run out") {
+    CHECK(table.intern("") == no_glyph);
+    CHECK(table.resolve(no_glyph).empty());
+    for (int i = 0; i < 128; ++i) {
+      table.intern("glyph " + std::to_string(i));
+    }
+    CHECK(table.interned() == 128);
+    CHECK(table.intern("one too many") == no_glyph);
+    CHECK(table.intern("glyph 127") == 255);
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// hashed timer wheel, a single clock driving any number of timers where
+// scheduling and firing cost the same however many are pending, timers more
+// than a lap away wait out the extra laps in their slot
+class timer_wheel_t {
+public:
+  explicit timer_wheel_t(const int slots) : slots_(slots) {}
+
+  [[nodiscard]] uint64_t now() const { return now_; }
+  [[nodiscard]] size_t pending() const { return pending_; }
+
+  // fire token after ticks (at least 1) more calls to advance()
+  void schedule(const uint64_t token, int ticks) {
+    ticks = ticks < 1 ? 1 : ticks;
+    const int slot_count = int(slots_.size());
+    const int slot = int((now_ + ticks) % slot_count);
+    slots_[slot].push_back(entry_t{token, (ticks - 1) / slot_count});
+    ++pending_;
+  }
+
+  // move the clock on a tick, calling fire(token) for every timer due, which
+  // is free to schedule more timers
+  template<typename fire_fn_t>
+  void advance(fire_fn_t&& fire) {
+    ++now_;
+    std::vector<entry_t>& slot = slots_[now_ % slots_.size()];
+    due_.clear();
+    std::swap(due_, slot);
+    for (const entry_t& entry : due_) {
+      if (entry.laps_ > 0) {
+        slot.push_back(entry_t{entry.token_, entry.laps_ - 1});
+      } else {
+        --pending_;
+        fire(entry.token_);
+      }
+    }
+  }
+
+private:
+  struct entry_t {
+    uint64_t token_;
+    int laps_; // full turns of the wheel still to wait
+  };
+
+  std::vector<std::vector<entry_t>> slots_;
+  std::vector<entry_t> due_; // reused while firing a slot
+  uint64_t now_ = 0;
+  size_t pending_ = 0;
+};
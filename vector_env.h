@@ -0,0 +1,90 @@
+#pragma once
+
+#include "breakout.h"
+
+#include <cstdint>
+#include <vector>
+
+// batched environment stepping many independent games in lockstep, writing
+// observations, rewards and done flags straight into caller owned buffers
+class vector_env_t {
+public:
+  enum action_e : int8_t { noop, left, right, launch };
+
+  // paddle x, ball x, ball y, ball velocity x, ball velocity y, lives, score,
+  // blocks remaining, game state
+  static constexpr int observation_size = 9;
+
+  vector_env_t(const int count, const int width, const int height)
+    : games_(count), scores_(count, 0) {
+    for (auto& game : games_) {
+      game.setup(0, 0, width, height);
+    }
+  }
+
+  [[nodiscard]] int count() const { return int(games_.size()); }
+  [[nodiscard]] const breakout_t& game(const int id) const {
+    return games_[id];
+  }
+
+  // restart the given games, optionally writing their observations to obs
+  // (id_count * observation_size values)
+  void reset(const int32_t* ids, const int id_count, int32_t* obs) {
+    for (int i = 0; i < id_count; ++i) {
+      const int id = ids[i];
+      games_[id].restart();
+      scores_[id] = games_[id].score();
+      if (obs != nullptr) {
+        observe(games_[id], obs + i * observation_size);
+      }
+    }
+  }
+
+  // apply one action to every game and advance each by a tick, reward is the
+  // change in score and done is set once a game is over or complete (buffers
+  // hold count() entries, obs count() * observation_size)
+  void step(
+    const int8_t* actions, int32_t* obs, float* reward, uint8_t* done) {
+    for (int id = 0; id < count(); ++id) {
+      breakout_t& game = games_[id];
+      switch (actions[id]) {
+        case left:
+          game.move_paddle_left(paddle_speed);
+          break;
+        case right:
+          game.move_paddle_right(paddle_speed);
+          break;
+        case launch:
+          game.launch_left();
+          break;
+        default:
+          break;
+      }
+      game.step();
+      const int score = game.score();
+      reward[id] = float(score - scores_[id]);
+      scores_[id] = score;
+      done[id] = game.state() == breakout_t::game_state_e::game_over
+              || game.state() == breakout_t::game_state_e::game_complete;
+      observe(game, obs + id * observation_size);
+    }
+  }
+
+  static void observe(const breakout_t& game, int32_t* obs) {
+    obs[0] = game.paddle_position().x_;
+    obs[1] = game.ball_position().x_;
+    obs[2] = game.ball_position().y_;
+    obs[3] = game.ball_velocity().x_;
+    obs[4] = game.ball_velocity().y_;
+    obs[5] = game.lives();
+    obs[6] = game.score();
+    obs[7] = game.blocks_remaining();
+    obs[8] = static_cast<int32_t>(game.state());
+  }
+
+private:
+  static constexpr int paddle_speed = 2; // matches the keyboard controls
+
+  std::vector<breakout_t> games_;
+  std::vector<int> scores_; // score at the end of the previous step
+};